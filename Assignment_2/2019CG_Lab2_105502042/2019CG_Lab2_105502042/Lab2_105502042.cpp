@@ -1,8 +1,10 @@
+#include "Stages.hpp"
 #include "my_utils.hpp"
 #include <chrono>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
 
 constexpr int window_width{800};
 constexpr int window_height{600};
@@ -12,6 +14,8 @@ constexpr Matrix<3> identity_matrix{{{1, 0, 0},
                                      {0, 1, 0},
                                      {0, 0, 1}}};
 std::string file_path;
+std::string out_prefix; // without a window every view is written to out_prefix<n>.ppm
+int frame_count{0};
 
 // polygon clipping
 template<typename Predicate1, typename Predicate2, typename Predicate3>
@@ -42,10 +46,12 @@ inline auto draw(const double wxl, const double wxr, const double wyb, const dou
                  const double vxl, const double vxr, const double vyb, const double vyt,
                  const Polygons<3>& polygons) {
   // draw borders
-  glColor3f(1.0, 1.0, 1.0);
+  StageTimer timer{Stage::rasterize};
+  set_color(1.0, 1.0, 1.0);
   draw_polygon<2>(Vertices<2>{{{vxl, vyb}, {vxr, vyb}, {vxr, vyt}, {vxl, vyt}}});
 
   // clipping
+  timer.next(Stage::clip);
   Polygons<3> a;
   Polygons<3> clipped_polys;
   clip_polygons(
@@ -79,13 +85,26 @@ inline auto draw(const double wxl, const double wxr, const double wyb, const dou
       [&](const auto s, const auto p) { return s < wyb && p >= wyb; });
 
   // map to window space and draw
-  glColor3f(1.0, 1.0, 0.0);
-  draw_polygons(transformed_ps(
+  timer.next(Stage::transform);
+  const auto window_polys = transformed_ps(
       Matrix<3>{t_m<3>(vxl, vyb) *
                 s_m<3>((vxr - vxl) / (wxr - wxl), (vyt - vyb) / (wyt - wyb)) *
                 t_m<3>(-wxl, -wyb)},
-      clipped_polys));
-  glFlush();
+      clipped_polys);
+  timer.next(Stage::rasterize);
+  set_color(1.0, 1.0, 0.0);
+  draw_polygons(window_polys);
+
+  timer.next(Stage::present);
+  if (canvas) {
+    if (const auto path = out_prefix + std::to_string(frame_count++) + ".ppm"; !canvas->write_ppm(path))
+      std::cerr << "cannot write " << path << '\n';
+  }
+#ifndef NO_GLUT
+  else {
+    glFlush();
+  }
+#endif
 }
 
 // simple hash function
@@ -124,12 +143,16 @@ auto displayFunc() {
       ss >> dx >> dy;
       t = t_m<3>(dx, dy) * t;
       break;
-    case "square"_hash: // draw a square
+    case "square"_hash: { // draw a square
+      const StageTimer timer{Stage::transform};
       polygons.push_back(std::move(transformed_vs(t, square_vs)));
       break;
-    case "triangle"_hash: // draw a triangle
+    }
+    case "triangle"_hash: { // draw a triangle
+      const StageTimer timer{Stage::transform};
       polygons.push_back(std::move(transformed_vs(t, triangle_vs)));
       break;
+    }
     case "view"_hash: // create a view (map to the screen)
       ss >> wxl >> wxr >> wyb >> wyt >> vxl >> vxr >> vyb >> vyt;
       {
@@ -138,7 +161,10 @@ auto displayFunc() {
         auto t1 = std::chrono::high_resolution_clock::now();
         std::cout << "draw() takes: " << std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() << "us\n";
       }
-      system("pause");
+#ifndef NO_GLUT
+      if (!canvas)
+        wait_for_enter();
+#endif
       break;
     case "clearData"_hash: // clear all recorded data, zero out all stats
       polygons.clear();
@@ -165,8 +191,38 @@ auto displayFunc() {
 }
 
 auto main(int argc, char* argv[]) -> int {
-  system("pause");
-  file_path = ((argc == 2) ? argv[1] : "lab2E.in");
+  // an output prefix renders out/view_0.ppm, out/view_1.ppm... without a window,
+  // --stages prints how long each stage of the pipeline took once the script is done
+  constexpr auto usage = "usage: Lab2 script.in [out/view_] [--stages]\n";
+  if (argc >= 2 && std::string_view{argv[1]}.rfind("--", 0) == 0) {
+    std::cerr << usage;
+    return EXIT_FAILURE;
+  }
+  file_path = ((argc >= 2) ? argv[1] : "lab2E.in");
+
+  bool stages{false};
+  for (int i = 2; i < argc; ++i) {
+    if (const std::string_view arg{argv[i]}; arg == "--stages") {
+      stages = true;
+    } else if (arg.rfind("--", 0) == 0) {
+      std::cerr << usage;
+      return EXIT_FAILURE;
+    } else {
+      canvas.emplace(window_width, window_height);
+      out_prefix = arg;
+    }
+  }
+  if (stages)
+    std::atexit([] { print_stages(std::cout); });
+  if (canvas) {
+    displayFunc();
+    return 0;
+  }
+#ifdef NO_GLUT
+  std::cerr << "this build has no window, pass an output prefix after the script\n";
+  return EXIT_FAILURE;
+#else
+  wait_for_enter();
 
   // init GLUT and create Window
   glutInit(&argc, argv);
@@ -187,4 +243,5 @@ auto main(int argc, char* argv[]) -> int {
   glFlush();
   // enter GLUT event processing cycle
   glutMainLoop();
+#endif
 }
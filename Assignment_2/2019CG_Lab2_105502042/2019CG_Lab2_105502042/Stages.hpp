@@ -0,0 +1,63 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+
+// wall time a run of a script spends in each stage of the pipeline, reported to the benchmark runner.
+// parse is whatever the run spends outside the other stages: reading the script, building the scene, culling...
+// stages that do not exist in a lab stay at 0. timers may run on any thread: scripts that run at once add up their times,
+// which can then exceed the wall time, and parse bottoms out at 0
+enum class Stage { parse, load, shade, transform, clip, rasterize, present };
+constexpr std::array<const char*, 7> stage_names{"parse", "load", "shade", "transform", "clip", "rasterize", "present"};
+
+using StageClock = std::chrono::steady_clock;
+inline std::array<std::atomic<StageClock::rep>, stage_names.size()> stage_ticks{};
+inline StageClock::time_point run_start{StageClock::now()};
+
+// adds the time from its construction to its destruction to a stage, next() moves on to another stage in between
+// and stop() ends the timing early, until the next next()
+class StageTimer {
+  Stage stage;
+  StageClock::time_point t0{StageClock::now()};
+  bool running{true};
+
+  void add(StageClock::time_point t1) { stage_ticks[static_cast<std::size_t>(stage)].fetch_add((t1 - t0).count(), std::memory_order_relaxed); }
+
+public:
+  explicit StageTimer(Stage stage) : stage{stage} {}
+  StageTimer(const StageTimer&) = delete;
+  StageTimer& operator=(const StageTimer&) = delete;
+  ~StageTimer() { stop(); }
+
+  void next(Stage s) {
+    const auto t1 = StageClock::now();
+    if (running)
+      add(t1);
+    t0 = t1;
+    stage = s;
+    running = true;
+  }
+
+  void stop() {
+    if (running)
+      add(StageClock::now());
+    running = false;
+  }
+};
+
+// one line, "stages" and a JSON object of milliseconds per stage since run_start
+inline void print_stages(std::ostream& out) {
+  const auto time = [](std::size_t i) { return StageClock::duration{stage_ticks[i].load(std::memory_order_relaxed)}; };
+  auto rest = StageClock::now() - run_start;
+  for (std::size_t i = 1; i < stage_ticks.size(); ++i)
+    rest -= time(i);
+  rest = std::max(rest, StageClock::duration::zero());
+  const auto ms = [](StageClock::duration d) { return std::chrono::duration<double, std::milli>{d}.count(); };
+  out << "stages {\"" << stage_names[0] << "\": " << ms(rest);
+  for (std::size_t i = 1; i < stage_ticks.size(); ++i)
+    out << ", \"" << stage_names[i] << "\": " << ms(time(i));
+  out << "}" << std::endl;
+}
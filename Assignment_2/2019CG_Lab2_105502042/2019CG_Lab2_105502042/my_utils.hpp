@@ -1,17 +1,98 @@
 #pragma once
 
-#include <GL/glut.h>
 #include <algorithm>
 #include <array>
 #include <cmath>
 #include <cstddef>
+#include <cstdlib>
 #include <execution>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
 #include <utility>
 #include <vector>
+#ifndef NO_GLUT // define NO_GLUT for a build that can only render to files
+#include <GL/glut.h>
+#endif
 
 constexpr int point_size{1}; // the number of pixels a point maps to
 
+// an RGB picture in memory that stands in for the window when there is none, rows count up from the bottom like the window's
+class Canvas {
+  int width, height;
+  std::vector<unsigned char> rgb;
+  std::array<unsigned char, 3> color{255, 255, 255};
+
+public:
+  Canvas(int width, int height) : width{width}, height{height}, rgb(static_cast<std::size_t>(width) * height * 3) {}
+
+  auto clear() { std::fill(rgb.begin(), rgb.end(), 0); }
+  auto set_color(unsigned char r, unsigned char g, unsigned char b) { color = {r, g, b}; }
+  auto plot(int x, int y) {
+    if (0 <= x && x < width && 0 <= y && y < height)
+      std::copy(color.begin(), color.end(), rgb.begin() + (static_cast<std::size_t>(y) * width + x) * 3);
+  }
+
+  // a binary PPM, which goes top to bottom
+  auto write_ppm(const std::string& path) const {
+    std::ofstream ppm{path, std::ios::binary};
+    ppm << "P6\n"
+        << width << ' ' << height << "\n255\n";
+    for (auto y = height - 1; y >= 0; --y)
+      ppm.write(reinterpret_cast<const char*>(rgb.data()) + static_cast<std::size_t>(y) * width * 3, static_cast<std::streamsize>(width) * 3);
+    return static_cast<bool>(ppm);
+  }
+};
+
+inline std::optional<Canvas> canvas; // set when running without a window, points are plotted there instead of through GL
+
+#ifdef NO_GLUT
+inline auto set_color(float r, float g, float b) {
+  canvas->set_color(static_cast<unsigned char>(r * 255), static_cast<unsigned char>(g * 255), static_cast<unsigned char>(b * 255));
+}
+inline auto begin_points() {}
+inline auto plot_point(int x, int y) { canvas->plot(x, y); }
+inline auto end_points() {}
+#else
+inline auto set_color(float r, float g, float b) {
+  if (canvas)
+    canvas->set_color(static_cast<unsigned char>(r * 255), static_cast<unsigned char>(g * 255), static_cast<unsigned char>(b * 255));
+  else
+    glColor3f(r, g, b);
+}
+
+inline auto begin_points() {
+  if (!canvas) {
+    glPointSize(point_size);
+    glBegin(GL_POINTS);
+  }
+}
+
+inline auto plot_point(int x, int y) {
+  if (canvas)
+    canvas->plot(x, y);
+  else
+    glVertex2i(x, y);
+}
+
+inline auto end_points() {
+  if (!canvas)
+    glEnd();
+}
+
+// what system("pause") does on Windows
+inline auto wait_for_enter() {
+#ifdef _WIN32
+  std::system("pause");
+#else
+  std::cout << "Press Enter to continue . . ." << std::flush;
+  std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+#endif
+}
+#endif
+
 template<std::size_t N>
 using Matrix = std::array<std::array<double, N>, N>;
 template<std::size_t N>
@@ -204,9 +285,8 @@ auto draw_line(const Vector<N>& endpoint1, const Vector<N>& endpoint2) {
     swap(x1, x2);
     swap(y1, y2);
   }
-  glPointSize(point_size);
-  glBegin(GL_POINTS);
-  glVertex2i(x1, y1); // draw the first point no matter wut
+  begin_points();
+  plot_point(x1, y1); // draw the first point no matter wut
 
   // preprocessing
   bool neg_slope{y1 > y2};
@@ -227,18 +307,18 @@ auto draw_line(const Vector<N>& endpoint1, const Vector<N>& endpoint2) {
     if (d <= 0) {  // choose E
       d += 2 * a;
       if (slope_grt_one)                                    // sort of "mirror" the negative slope line back to where it's supposed to be
-        glVertex2i(y, !neg_slope ? (++x) : (2 * x1 - ++x)); // slope > 1 y is actually x and vice versa
+        plot_point(y, !neg_slope ? (++x) : (2 * x1 - ++x)); // slope > 1 y is actually x and vice versa
       else
-        glVertex2i(++x, !neg_slope ? (y) : (2 * y1 - y));
+        plot_point(++x, !neg_slope ? (y) : (2 * y1 - y));
     } else { // choose NE
       d += 2 * (a + b);
       if (slope_grt_one)
-        glVertex2i(++y, !neg_slope ? (++x) : (2 * x1 - ++x));
+        plot_point(++y, !neg_slope ? (++x) : (2 * x1 - ++x));
       else
-        glVertex2i(++x, !neg_slope ? (++y) : (2 * y1 - ++y));
+        plot_point(++x, !neg_slope ? (++y) : (2 * y1 - ++y));
     }
   }
-  glEnd();
+  end_points();
 }
 
 template<std::size_t N>
@@ -289,7 +369,14 @@ inline auto transformed_ps(const Matrix<N>& t, const Polygons<N>& ps) -> Polygon
   return ret;
 }
 
-#define clear_screen()              \
-  glClearColor(0.0, 0.0, 0.0, 0.0); \
-  glClear(GL_COLOR_BUFFER_BIT);     \
-  glFlush()
+inline auto clear_screen() {
+  if (canvas) {
+    canvas->clear();
+    return;
+  }
+#ifndef NO_GLUT
+  glClearColor(0.0, 0.0, 0.0, 0.0);
+  glClear(GL_COLOR_BUFFER_BIT);
+  glFlush();
+#endif
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "MatrixKit.hpp"
+#include <utility>
+
+// the six frustum planes of homogeneous clip space, v is inside plane P iff plane_distance<P>(v) >= 0
+template<int Plane>
+constexpr auto plane_distance(const Vector<4>& v) {
+  static_assert(0 <= Plane && Plane < 6, "there are only six frustum planes");
+  if constexpr (Plane == 0)
+    return v[3] - v[0]; // w - x
+  else if constexpr (Plane == 1)
+    return v[3] + v[0]; // w + x
+  else if constexpr (Plane == 2)
+    return v[3] - v[1]; // w - y
+  else if constexpr (Plane == 3)
+    return v[3] + v[1]; // w + y
+  else if constexpr (Plane == 4)
+    return v[3] - v[2]; // w - z
+  else
+    return v[2]; // z
+}
+
+// bit P is set iff v lies outside plane P
+constexpr auto outcode(const Vector<4>& v) {
+  return static_cast<unsigned char>((plane_distance<0>(v) < 0) | (plane_distance<1>(v) < 0) << 1 | (plane_distance<2>(v) < 0) << 2 |
+                                    (plane_distance<3>(v) < 0) << 3 | (plane_distance<4>(v) < 0) << 4 | (plane_distance<5>(v) < 0) << 5);
+}
+
+// a convex polygon kept on the stack, push_back past Capacity is undefined
+template<typename Vertex, size_t Capacity>
+class FixedPolygon {
+  std::array<Vertex, Capacity> vs;
+  size_t n{0};
+
+public:
+  auto push_back(const Vertex& v) { vs[n++] = v; }
+  auto clear() { n = 0; }
+  auto size() const { return n; }
+  auto empty() const { return n == 0; }
+  const auto& operator[](size_t i) const { return vs[i]; }
+  auto begin() const { return vs.begin(); }
+  auto end() const { return vs.begin() + n; }
+};
+
+constexpr size_t max_clip_input{4};                 // faces are triangles or quads
+constexpr size_t clip_capacity{max_clip_input + 6}; // each plane adds at most one vertex to a convex polygon
+
+template<typename Vertex>
+using ClipPolygon = FixedPolygon<Vertex, clip_capacity>;
+
+// where a vertex is in clip space, overload it for vertices that carry more than a position
+constexpr const auto& clip_position(const Vector<4>& v) { return v; }
+
+// Sutherland-Hodgman against a single plane, in and out must not be the same polygon
+template<int Plane, typename Vertex>
+inline void clip_against(const ClipPolygon<Vertex>& in, ClipPolygon<Vertex>& out) {
+  out.clear();
+  const auto sz = in.size();
+  for (size_t i = 0; i < sz; ++i) {
+    const auto& s = in[i];
+    const auto& p = in[i + 1 == sz ? 0 : i + 1];
+    const double c1{plane_distance<Plane>(clip_position(s))}, c2{plane_distance<Plane>(clip_position(p))};
+    if (c1 >= 0 && c2 >= 0) { // in2in
+      out.push_back(p);
+    } else if (c1 >= 0) { // in2out
+      out.push_back(s + c1 / (c1 - c2) * (p - s));
+    } else if (c2 >= 0) { // out2in
+      out.push_back(s + c1 / (c1 - c2) * (p - s));
+      out.push_back(p);
+    }
+  }
+}
+
+template<typename Vertex, int... Planes>
+inline auto clip_polygon(const ClipPolygon<Vertex>& polygon, unsigned char planes, std::integer_sequence<int, Planes...>) {
+  ClipPolygon<Vertex> a{polygon}, b;
+  auto *in = &a, *out = &b;
+  ((planes & 1 << Planes ? (clip_against<Planes>(*in, *out), std::swap(in, out)) : void()), ...);
+  return *in;
+}
+
+// clip a polygon against the planes whose bits are set in planes, usually the or of its vertices' outcodes,
+// the planes no vertex lies outside of are skipped
+template<typename Vertex>
+inline auto clip_polygon(const ClipPolygon<Vertex>& polygon, unsigned char planes) {
+  return clip_polygon(polygon, planes, std::make_integer_sequence<int, 6>{});
+}
@@ -1,9 +1,84 @@
 #pragma once
+#include "Clipper.hpp"
 #include "MatrixKit.hpp"
+#include "Profile.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
+#ifndef NO_GLUT // define NO_GLUT for a build that can only render to files
 #include <GL/glut.h>
+#endif
 
 constexpr int point_size{1}; // the number of pixels a point maps to
 
+// an RGB picture in memory that stands in for the window when there is none, rows count up from the bottom like the window's
+class Canvas {
+  int width, height;
+  std::vector<unsigned char> rgb;
+  std::array<unsigned char, 3> color{255, 255, 255};
+
+public:
+  Canvas(int width, int height) : width{width}, height{height}, rgb(static_cast<size_t>(width) * height * 3) {}
+
+  auto clear() { std::fill(rgb.begin(), rgb.end(), 0); }
+  auto set_color(unsigned char r, unsigned char g, unsigned char b) { color = {r, g, b}; }
+  auto plot(int x, int y) {
+    if (0 <= x && x < width && 0 <= y && y < height)
+      std::copy(color.begin(), color.end(), rgb.begin() + (static_cast<size_t>(y) * width + x) * 3);
+  }
+
+  // a binary PPM, which goes top to bottom
+  auto write_ppm(const std::string& path) const {
+    PROFILE_ZONE("write_ppm");
+    std::ofstream ppm{path, std::ios::binary};
+    ppm << "P6\n"
+        << width << ' ' << height << "\n255\n";
+    for (auto y = height - 1; y >= 0; --y)
+      ppm.write(reinterpret_cast<const char*>(rgb.data()) + static_cast<size_t>(y) * width * 3, static_cast<std::streamsize>(width) * 3);
+    return static_cast<bool>(ppm);
+  }
+};
+
+inline std::optional<Canvas> canvas; // set when running without a window, points are plotted there instead of through GL
+
+#ifdef NO_GLUT
+inline auto begin_points() {}
+inline auto plot_point(int x, int y) { canvas->plot(x, y); }
+inline auto end_points() {}
+#else
+inline auto begin_points() {
+  if (!canvas) {
+    glPointSize(point_size);
+    glBegin(GL_POINTS);
+  }
+}
+
+inline auto plot_point(int x, int y) {
+  if (canvas)
+    canvas->plot(x, y);
+  else
+    glVertex2i(x, y);
+}
+
+inline auto end_points() {
+  if (!canvas)
+    glEnd();
+}
+
+// what system("pause") does on Windows
+inline auto wait_for_enter() {
+#ifdef _WIN32
+  std::system("pause");
+#else
+  std::cout << "Press Enter to continue . . ." << std::flush;
+  std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+#endif
+}
+#endif
+
 template<size_t N>
 auto draw_line(const Vector<N>& endpoint1, const Vector<N>& endpoint2) {
   // unpack data
@@ -16,9 +91,8 @@ auto draw_line(const Vector<N>& endpoint1, const Vector<N>& endpoint2) {
     swap(x1, x2);
     swap(y1, y2);
   }
-  glPointSize(point_size);
-  glBegin(GL_POINTS);
-  glVertex2i(x1, y1); // draw the first point no matter wut
+  begin_points();
+  plot_point(x1, y1); // draw the first point no matter wut
 
   // preprocessing
   const bool neg_slope{y1 > y2};
@@ -30,23 +104,24 @@ auto draw_line(const Vector<N>& endpoint1, const Vector<N>& endpoint2) {
     swap(x1, y1);
     swap(x2, y2);
   }
+  PROFILE_COUNT(Counter::points_plotted, x2 - x1 + 1);
   int x{x1}, y{y1}, a{y2 - y1}, b{x1 - x2}, d{2 * a + b};
   while (x < x2) { // draw from left to right (recall that we make x2 be always on the right)
     if (d <= 0) {  // choose E
       d += 2 * a;
       if (slope_grt_one)                                    // sort of "mirror" the negative slope line back to where it's supposed to be
-        glVertex2i(y, !neg_slope ? (++x) : (2 * x1 - ++x)); // slope > 1 y is actually x and vice versa
+        plot_point(y, !neg_slope ? (++x) : (2 * x1 - ++x)); // slope > 1 y is actually x and vice versa
       else
-        glVertex2i(++x, !neg_slope ? (y) : (2 * y1 - y));
+        plot_point(++x, !neg_slope ? (y) : (2 * y1 - y));
     } else { // choose NE
       d += 2 * (a + b);
       if (slope_grt_one)
-        glVertex2i(++y, !neg_slope ? (++x) : (2 * x1 - ++x));
+        plot_point(++y, !neg_slope ? (++x) : (2 * x1 - ++x));
       else
-        glVertex2i(++x, !neg_slope ? (++y) : (2 * y1 - ++y));
+        plot_point(++x, !neg_slope ? (++y) : (2 * y1 - ++y));
     }
   }
-  glEnd();
+  end_points();
 }
 
 template<size_t N>
@@ -59,52 +134,55 @@ inline auto draw_polygon(const Polygon_u<N>& vs) {
   for (auto it = vs.cbegin() + 1; it != vs.cend(); ++it)
     draw_line(*(it - 1), *it);
 
-  glFlush();
+#ifndef NO_GLUT
+  if (!canvas)
+    glFlush();
+#endif
 }
 
 template<size_t N>
 inline auto draw_polygons(const Polygons<N>& ps) {
+  PROFILE_ZONE("draw_polygons");
   for (const auto& vs : ps)
     draw_polygon(vs);
 }
 
 inline auto project_clip_pd(const Polygons<4>& polygons, const Matrix<4>& pmXem) {
-  using Codes = std::array<const std::function<double(const Vector<4>&)>, 6>;
-  const Codes codes{{[](const Vector<4>& v) { return v[3] - v[0]; }, [](const Vector<4>& v) { return v[3] + v[0]; }, // w - x, w + x
-                     [](const Vector<4>& v) { return v[3] - v[1]; }, [](const Vector<4>& v) { return v[3] + v[1]; }, // w - y, w + y
-                     [](const Vector<4>& v) { return v[3] - v[2]; }, [](const Vector<4>& v) { return v[2]; }}};      // w - z, w
-  Polygons<4> clipped_polys;
-  std::mutex lock_clipped_polys;
-
-  std::for_each(std::execution::par_unseq, polygons.begin(), polygons.end(), [&](Polygon_u<4> polygon) {
-    polygon = pmXem * polygon; // project a polygon to projection space
-
-    Polygon_u<4> relay;
-    for (const auto& c : codes) { // clip against all six planes
-      const auto sz = polygon.size();
-      for (size_t i = 0; i < sz; ++i) {
-        const auto& s = polygon[i];
-        const auto& p = polygon[(i + 1) % sz];
-        if (const double c1{c(s)}, c2{c(p)}; (c1 >= 0 && c2 >= 0)) { // in2in
-          relay.push_back(p);
-        } else if (const auto new_s = (s + c1 / (c1 - c2) * (p - s)); (c1 >= 0 && c2 < 0)) { // in2out
-          relay.push_back(new_s);
-        } else if (c1 < 0 && c2 >= 0) { // out2in
-          relay.push_back(new_s);
-          relay.push_back(p);
-        }
-      }
-      polygon = relay;
-      relay.clear();
-    }
+  PROFILE_ZONE("project_clip_pd");
+  PROFILE_COUNT(Counter::polygons_in, polygons.size());
+  // every polygon owns one output slot, so threads never share a container and the result keeps the input order.
+  // polygons that are clipped away leave an empty slot behind, which the stable compaction below removes
+  Polygons<4> clipped_polys(polygons.size());
 
-    if (polygon.size()) {
-      for (auto& a : polygon) // perspective division
-        if (a[3] != 1)
-          a = Vector<4>{{a[0] / a[3], a[1] / a[3], a[2] / a[3], 1.0}};
-      std::lock_guard l{lock_clipped_polys};
-      clipped_polys.push_back(std::move(polygon));
+  std::transform(std::execution::par, polygons.begin(), polygons.end(), clipped_polys.begin(), [&](const Polygon_u<4>& input) {
+    ClipPolygon<Vector<4>> polygon;
+    unsigned char all_out{0xFF}, any_out{0};
+    for (const auto& v : input) { // project a polygon to projection space and record the planes each vertex lies outside of
+      const auto a = pmXem * v;
+      all_out &= outcode(a);
+      any_out |= outcode(a);
+      polygon.push_back(a);
+    }
+    if (all_out) { // every vertex is outside the same plane
+      PROFILE_COUNT(Counter::polygons_clipped_away, 1);
+      return Polygon_u<4>{};
+    }
+    if (any_out) { // crosses a plane, clip against the planes it crosses
+      polygon = clip_polygon(polygon, any_out);
+      if (polygon.size() > input.size()) // like lab 4, only what clipping adds to the polygon, not the vertices it keeps
+        PROFILE_COUNT(Counter::clip_vertices, polygon.size() - input.size());
+      if (polygon.empty())
+        PROFILE_COUNT(Counter::polygons_clipped_away, 1);
     }
+
+    Polygon_u<4> ret;
+    ret.reserve(polygon.size());
+    for (const auto& a : polygon) // perspective division
+      ret.push_back(a[3] != 1 ? Vector<4>{{a[0] / a[3], a[1] / a[3], a[2] / a[3], 1.0}} : a);
+    return ret;
   });
+
+  clipped_polys.erase(std::remove_if(std::execution::par, clipped_polys.begin(), clipped_polys.end(), [](const Polygon_u<4>& p) { return p.empty(); }),
+                      clipped_polys.end());
   return clipped_polys;
 }
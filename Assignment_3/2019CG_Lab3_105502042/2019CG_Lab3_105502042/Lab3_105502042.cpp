@@ -1,11 +1,17 @@
 #include "DrawKit.hpp"
 #include "Object.hpp"
 #include "Observer.hpp"
+#include "Profile.hpp"
+#include "Stages.hpp"
 #include "Viewport.hpp"
+#include <string_view>
 
 std::ifstream in_file;
 int win_x, win_y;
 bool nobackfaces{false};
+std::string out_prefix; // without a window every display is written to out_prefix<n>.ppm
+int frame_count{0};
+std::string trace_path; // where the zones and counters of a PROFILE build go when the program ends
 
 auto process_scale(std::stringstream& ss) {
   double x, y, z;
@@ -37,6 +43,7 @@ auto process_viewport(std::stringstream& ss) {
 }
 
 auto process_object(std::stringstream& ss, const Matrix<4>& TM) {
+  const StageTimer timer{Stage::load};
   // open asc file
   std::string asc_path;
   ss >> asc_path;
@@ -72,13 +79,16 @@ auto process_observer(std::stringstream& ss) {
 
 auto process_display(const Viewport& vp, const std::vector<Object>& objects, const Matrix<4>& pmXem) {
   auto t0 = std::chrono::high_resolution_clock::now();
+  PROFILE_ZONE("display");
   // dump all faces of all objects to Polygons<4>
+  StageTimer timer{Stage::transform};
   Polygons<4> ps;
   for (const auto& obj : objects) {
     const auto&& a = obj.to_polygons();
     ps.insert(ps.end(), a.begin(), a.end());
   }
 
+  timer.next(Stage::clip);
   ps = project_clip_pd(ps, pmXem); // performs projection, clipping, and perspective division in parallel
 
   // nobackfaces
@@ -87,15 +97,38 @@ auto process_display(const Viewport& vp, const std::vector<Object>& objects, con
                             [](const auto& a) { return cross(a[1] - a[0], a[2] - a[1])[2] >= 0; }),
              ps.end());
 
-  glClearColor(0.0, 0.0, 0.0, 0.0);
-  glClear(GL_COLOR_BUFFER_BIT);
+  timer.next(Stage::transform);
   const auto [vxl, vxr, vyb, vyt] = vp.get_borders();
+  ps = translation_m(vxl, vyb) * scaling_m((vxr - vxl) / 2.0, (vyt - vyb) / 2.0) * translation_m(1.0, 1.0) * ps;
+
+  timer.next(Stage::rasterize);
+  if (canvas) {
+    canvas->clear();
+  }
+#ifndef NO_GLUT
+  else {
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+#endif
   draw_polygon(Polygon_u<2>{{{vxl, vyb}, {vxr, vyb}, {vxr, vyt}, {vxl, vyt}}}); // this function will do the flushing
-  draw_polygons(translation_m(vxl, vyb) * scaling_m((vxr - vxl) / 2.0, (vyt - vyb) / 2.0) * translation_m(1.0, 1.0) * ps);
+  draw_polygons(ps);
+
+  timer.next(Stage::present);
+  if (canvas) {
+    const auto path = out_prefix + std::to_string(frame_count++) + ".ppm";
+    if (!canvas->write_ppm(path))
+      std::cerr << "cannot write " << path << '\n';
+  }
+  timer.stop();
+  PROFILE_FRAME();
 
   auto t1 = std::chrono::high_resolution_clock::now();
   std::cout << "display takes: " << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() << "ms\n";
-  system("pause");
+#ifndef NO_GLUT
+  if (!canvas)
+    wait_for_enter();
+#endif
 }
 
 // simple hash function
@@ -156,14 +189,53 @@ auto displayFunc() {
 
 auto main(int argc, char* argv[]) -> int {
   std::ios_base::sync_with_stdio(false);
-  in_file.open(((argc == 2) ? argv[1] : "../Debug/Lab3C.in")); // Lab3A.in, simple.in...
+  // an output prefix renders out/frame_0.ppm, out/frame_1.ppm... without a window, --stages prints how long each stage of the
+  // pipeline took once the script is done, --trace saves what a PROFILE build recorded as Chrome trace events
+  constexpr auto usage = "usage: Lab3 script.in [out/frame_] [--stages] [--trace trace.json]\n";
+  if (argc >= 2 && std::string_view{argv[1]}.rfind("--", 0) == 0) {
+    std::cerr << usage;
+    return EXIT_FAILURE;
+  }
+  in_file.open(((argc >= 2) ? argv[1] : "../Debug/Lab3C.in")); // Lab3A.in, simple.in...
   if (!in_file)
     return -1;
   std::string line;
   std::getline(in_file, line);
   std::stringstream ss{line};
   ss >> win_x >> win_y;
-  system("pause");
+
+  bool stages{false};
+  for (int i = 2; i < argc; ++i) {
+    if (const std::string_view arg{argv[i]}; arg == "--stages") {
+      stages = true;
+    } else if (arg == "--trace" && i + 1 < argc) {
+      trace_path = argv[++i];
+    } else if (arg.rfind("--", 0) == 0) { // unknown, or --trace without a path
+      std::cerr << usage;
+      return EXIT_FAILURE;
+    } else {
+      canvas.emplace(win_x, win_y);
+      out_prefix = arg;
+    }
+  }
+  if (stages)
+    std::atexit([] { print_stages(std::cout); });
+  if (!trace_path.empty() && !profile_enabled)
+    std::cerr << "--trace needs a build with PROFILE defined\n";
+  else if (!trace_path.empty())
+    std::atexit([] {
+      if (!write_trace(trace_path))
+        std::cerr << "cannot write " << trace_path << '\n';
+    });
+  if (canvas) {
+    displayFunc();
+    return 0;
+  }
+#ifdef NO_GLUT
+  std::cerr << "this build has no window, pass an output prefix after the script\n";
+  return EXIT_FAILURE;
+#else
+  wait_for_enter();
 
   // GLUT stuff
   glutInit(&argc, argv);
@@ -179,4 +251,5 @@ auto main(int argc, char* argv[]) -> int {
   gluOrtho2D(0.0, win_x, 0.0, win_y);
   glFlush();
   glutMainLoop();
+#endif
 }
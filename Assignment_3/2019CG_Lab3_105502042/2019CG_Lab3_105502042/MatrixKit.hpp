@@ -1,7 +1,11 @@
 #pragma once
 #include <array>
+#include <cmath>
 #include <execution>
 #include <iostream>
+#if !defined(NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <immintrin.h>
+#endif
 
 template<size_t N, typename T = double>
 using Matrix = std::array<std::array<T, N>, N>;
@@ -46,14 +50,18 @@ constexpr auto operator*(const Vector<N, T>& lhs, const Vector<N, T>& rhs) {
   return std::inner_product(lhs.begin(), lhs.end(), rhs.begin(), 0.0);
 }
 
-// matrix multiplication
+// matrix multiplication, sums in the same order as an inner product of a row and a column
 template<size_t N, typename T = double>
 constexpr auto operator*(const Matrix<N, T>& lhs, const Matrix<N, T>& rhs) {
   Matrix<N, T> product{};
-  auto rhst{transpose(rhs)};
-  for (size_t i = 0; i < N; ++i)
-    for (size_t j = 0; j < N; ++j)
-      product[i][j] = lhs[i] * rhst[j];
+  for (size_t i = 0; i < N; ++i) {
+    for (size_t j = 0; j < N; ++j) {
+      auto sum{0.0};
+      for (size_t k = 0; k < N; ++k)
+        sum = sum + lhs[i][k] * rhs[k][j];
+      product[i][j] = static_cast<T>(sum);
+    }
+  }
   return product;
 }
 
@@ -65,6 +73,95 @@ constexpr auto operator*(const Matrix<N, T>& lhs, const Vector<N, T>& rhs) {
   return ret;
 }
 
+// 4-wide kernels for Matrix<4> and Vector<4> of double and float, picked at compile time. define NO_SIMD to fall back
+// to the generic templates above, which keep their exact summation order
+#if !defined(NO_SIMD) && defined(__AVX__)
+#define MATRIXKIT_AVX
+#endif
+#if !defined(NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MATRIXKIT_SSE2
+#endif
+
+#ifdef MATRIXKIT_AVX
+// matrix X vector ⟼ vector, four row products summed horizontally
+inline auto operator*(const Matrix<4>& lhs, const Vector<4>& rhs) {
+  const __m256d v{_mm256_loadu_pd(rhs.data())};
+  const __m256d s01{_mm256_hadd_pd(_mm256_mul_pd(_mm256_loadu_pd(lhs[0].data()), v), _mm256_mul_pd(_mm256_loadu_pd(lhs[1].data()), v))};
+  const __m256d s23{_mm256_hadd_pd(_mm256_mul_pd(_mm256_loadu_pd(lhs[2].data()), v), _mm256_mul_pd(_mm256_loadu_pd(lhs[3].data()), v))};
+  Vector<4> ret;
+  _mm256_storeu_pd(ret.data(), _mm256_add_pd(_mm256_permute2f128_pd(s01, s23, 0x20), _mm256_permute2f128_pd(s01, s23, 0x31)));
+  return ret;
+}
+
+// matrix multiplication, each row of the product is a combination of the rows of rhs so nothing is transposed
+inline auto operator*(const Matrix<4>& lhs, const Matrix<4>& rhs) {
+  const __m256d r[]{_mm256_loadu_pd(rhs[0].data()), _mm256_loadu_pd(rhs[1].data()), _mm256_loadu_pd(rhs[2].data()), _mm256_loadu_pd(rhs[3].data())};
+  Matrix<4> product;
+  for (size_t i = 0; i < 4; ++i) {
+    __m256d row{_mm256_mul_pd(_mm256_set1_pd(lhs[i][0]), r[0])};
+    for (size_t k = 1; k < 4; ++k)
+      row = _mm256_add_pd(row, _mm256_mul_pd(_mm256_set1_pd(lhs[i][k]), r[k]));
+    _mm256_storeu_pd(product[i].data(), row);
+  }
+  return product;
+}
+#elif defined(MATRIXKIT_SSE2)
+// matrix X vector ⟼ vector, two rows per register pair
+inline auto operator*(const Matrix<4>& lhs, const Vector<4>& rhs) {
+  const __m128d v01{_mm_loadu_pd(rhs.data())}, v23{_mm_loadu_pd(rhs.data() + 2)};
+  const auto half_sums = [&](const Vector<4>& row) { // [a0 + a2, a1 + a3]
+    return _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(row.data()), v01), _mm_mul_pd(_mm_loadu_pd(row.data() + 2), v23));
+  };
+  const auto sum_pair = [&](const __m128d a, const __m128d b) { return _mm_add_pd(_mm_unpacklo_pd(a, b), _mm_unpackhi_pd(a, b)); };
+  Vector<4> ret;
+  _mm_storeu_pd(ret.data(), sum_pair(half_sums(lhs[0]), half_sums(lhs[1])));
+  _mm_storeu_pd(ret.data() + 2, sum_pair(half_sums(lhs[2]), half_sums(lhs[3])));
+  return ret;
+}
+
+// matrix multiplication, each row of the product is a combination of the rows of rhs so nothing is transposed
+inline auto operator*(const Matrix<4>& lhs, const Matrix<4>& rhs) {
+  Matrix<4> product;
+  for (size_t i = 0; i < 4; ++i) {
+    __m128d lo{_mm_setzero_pd()}, hi{_mm_setzero_pd()};
+    for (size_t k = 0; k < 4; ++k) {
+      const __m128d s{_mm_set1_pd(lhs[i][k])};
+      lo = _mm_add_pd(lo, _mm_mul_pd(s, _mm_loadu_pd(rhs[k].data())));
+      hi = _mm_add_pd(hi, _mm_mul_pd(s, _mm_loadu_pd(rhs[k].data() + 2)));
+    }
+    _mm_storeu_pd(product[i].data(), lo);
+    _mm_storeu_pd(product[i].data() + 2, hi);
+  }
+  return product;
+}
+#endif
+
+#ifdef MATRIXKIT_SSE2
+// matrix X vector ⟼ vector in single precision, the four row products are transposed and summed vertically
+inline auto operator*(const Matrix<4, float>& lhs, const Vector<4, float>& rhs) {
+  const __m128 v{_mm_loadu_ps(rhs.data())};
+  __m128 p0{_mm_mul_ps(_mm_loadu_ps(lhs[0].data()), v)}, p1{_mm_mul_ps(_mm_loadu_ps(lhs[1].data()), v)};
+  __m128 p2{_mm_mul_ps(_mm_loadu_ps(lhs[2].data()), v)}, p3{_mm_mul_ps(_mm_loadu_ps(lhs[3].data()), v)};
+  _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+  Vector<4, float> ret;
+  _mm_storeu_ps(ret.data(), _mm_add_ps(_mm_add_ps(p0, p1), _mm_add_ps(p2, p3)));
+  return ret;
+}
+
+// matrix multiplication in single precision
+inline auto operator*(const Matrix<4, float>& lhs, const Matrix<4, float>& rhs) {
+  const __m128 r[]{_mm_loadu_ps(rhs[0].data()), _mm_loadu_ps(rhs[1].data()), _mm_loadu_ps(rhs[2].data()), _mm_loadu_ps(rhs[3].data())};
+  Matrix<4, float> product;
+  for (size_t i = 0; i < 4; ++i) {
+    __m128 row{_mm_mul_ps(_mm_set1_ps(lhs[i][0]), r[0])};
+    for (size_t k = 1; k < 4; ++k)
+      row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(lhs[i][k]), r[k]));
+    _mm_storeu_ps(product[i].data(), row);
+  }
+  return product;
+}
+#endif
+
 // scalar X vector ⟼ vector
 template<typename Scalar, size_t N, typename T = double>
 constexpr auto operator*(const Scalar lhs, const Vector<N, T>& rhs) {
@@ -0,0 +1,38 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// first in first out between threads, push waits while capacity items are queued and pop waits while none are
+template<typename T>
+class BoundedQueue {
+  std::mutex mutex; // guards items
+  std::condition_variable not_full, not_empty;
+  std::deque<T> items;
+  size_t capacity;
+
+public:
+  explicit BoundedQueue(size_t capacity) : capacity{capacity} {}
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+  void push(T item) {
+    {
+      std::unique_lock lock{mutex};
+      not_full.wait(lock, [&] { return items.size() < capacity; });
+      items.push_back(std::move(item));
+    }
+    not_empty.notify_one();
+  }
+
+  auto pop() {
+    std::unique_lock lock{mutex};
+    not_empty.wait(lock, [&] { return !items.empty(); });
+    auto item = std::move(items.front());
+    items.pop_front();
+    lock.unlock();
+    not_full.notify_one();
+    return item;
+  }
+};
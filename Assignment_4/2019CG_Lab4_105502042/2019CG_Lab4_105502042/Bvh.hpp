@@ -0,0 +1,147 @@
+#pragma once
+#include "Mesh.hpp"
+#include <cstdint>
+#include <numeric>
+#include <optional>
+
+inline auto merge(const Aabb& a, const Aabb& b) {
+  Aabb box;
+  for (size_t k = 0; k < 3; ++k) {
+    box.min[k] = std::min(a.min[k], b.min[k]);
+    box.max[k] = std::max(a.max[k], b.max[k]);
+  }
+  return box;
+}
+
+// the center of an empty box is the origin so it still sorts
+inline auto center_of(const Aabb& b) {
+  return b.empty() ? Vector<3>{} : Vector<3>{{(b.min[0] + b.max[0]) / 2, (b.min[1] + b.max[1]) / 2, (b.min[2] + b.max[2]) / 2}};
+}
+
+struct Ray {
+  Vector<4> origin, direction; // w is ignored
+};
+
+// where along r it enters b, nothing if it misses b or b is behind r's origin
+inline auto intersect(const Ray& r, const Aabb& b) -> std::optional<double> {
+  double t0{0}, t1{std::numeric_limits<double>::infinity()};
+  for (size_t k = 0; k < 3; ++k) { // slab test, a zero direction gives infinities that compare the right way
+    const double inv{1 / r.direction[k]};
+    double near{(b.min[k] - r.origin[k]) * inv}, far{(b.max[k] - r.origin[k]) * inv};
+    if (near > far)
+      swap(near, far);
+    t0 = std::max(t0, near);
+    t1 = std::min(t1, far);
+    if (t0 > t1)
+      return std::nullopt;
+  }
+  return t0;
+}
+
+// where along r it hits the triangle (a, b, c) from either side, Moller-Trumbore
+inline auto intersect(const Ray& r, const Vector<4>& a, const Vector<4>& b, const Vector<4>& c) -> std::optional<double> {
+  const auto e1 = b - a, e2 = c - a;
+  const auto p = cross(r.direction, e2);
+  const auto det = dot_3D(e1, p);
+  if (std::abs(det) < 1e-12)
+    return std::nullopt;
+  const auto s = r.origin - a;
+  const auto u = dot_3D(s, p) / det;
+  if (u < 0 || u > 1)
+    return std::nullopt;
+  const auto q = cross(s, e1);
+  const auto v = dot_3D(r.direction, q) / det;
+  if (v < 0 || u + v > 1)
+    return std::nullopt;
+  const auto t = dot_3D(e2, q) / det;
+  return t >= 0 ? std::optional{t} : std::nullopt;
+}
+
+// bounding volume hierarchy over a list of boxes, e.g. one per object, split at the median of the widest axis.
+// nodes are stored depth first so a node's left child directly follows it.
+// frustum culling and picking query it, occlusion does not: an object hidden behind others is only rejected by the
+// rasterizer's depth pyramid, after it has been shaded, projected and set up
+class Bvh {
+  struct Node {
+    Aabb box;
+    std::uint32_t first, count; // a leaf holds items[first, first + count), an inner node has count 0 and first is its right child
+  };
+
+  static constexpr std::uint32_t leaf_size{4};
+
+  std::vector<Aabb> boxes;
+  std::vector<std::uint32_t> items; // indices into boxes, reordered so every leaf's items are contiguous
+  std::vector<Node> nodes;
+
+public:
+  Bvh() = default;
+  explicit Bvh(std::vector<Aabb> bs);
+
+  // the number of boxes it was built from
+  auto size() const { return boxes.size(); }
+
+  // call visit(i) for every box i that passes overlaps(box), a subtree is skipped as soon as its bounds fail.
+  // overlaps is asked again after earlier visits, so it may tighten as the query goes (e.g. the nearest hit so far)
+  template<typename Overlaps, typename Visit>
+  void query(Overlaps overlaps, Visit visit) const;
+
+private:
+  void build(std::uint32_t first, std::uint32_t count);
+};
+
+inline Bvh::Bvh(std::vector<Aabb> bs) : boxes{std::move(bs)}, items(boxes.size()) {
+  std::iota(items.begin(), items.end(), 0u);
+  if (!items.empty())
+    build(0, static_cast<std::uint32_t>(items.size()));
+}
+
+inline void Bvh::build(std::uint32_t first, std::uint32_t count) {
+  const auto node = nodes.size();
+  nodes.push_back(Node{});
+  Aabb box, centers;
+  for (auto i = first; i < first + count; ++i) {
+    box = merge(box, boxes[items[i]]);
+    const auto c = center_of(boxes[items[i]]);
+    centers = merge(centers, Aabb{c, c});
+  }
+  nodes[node].box = box;
+  if (count <= leaf_size) {
+    nodes[node].first = first;
+    nodes[node].count = count;
+    return;
+  }
+
+  size_t axis{0};
+  for (size_t k = 1; k < 3; ++k)
+    if (centers.max[k] - centers.min[k] > centers.max[axis] - centers.min[axis])
+      axis = k;
+  const auto half = count / 2;
+  std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+                   [&](std::uint32_t a, std::uint32_t b) { return center_of(boxes[a])[axis] < center_of(boxes[b])[axis]; });
+  build(first, half);
+  nodes[node].first = static_cast<std::uint32_t>(nodes.size());
+  nodes[node].count = 0;
+  build(first + half, count - half);
+}
+
+template<typename Overlaps, typename Visit>
+inline void Bvh::query(Overlaps overlaps, Visit visit) const {
+  if (nodes.empty())
+    return;
+  std::vector<std::uint32_t> stack{0};
+  while (!stack.empty()) {
+    const auto n = stack.back();
+    stack.pop_back();
+    const auto& node = nodes[n];
+    if (!overlaps(node.box))
+      continue;
+    if (node.count) {
+      for (auto i = node.first; i < node.first + node.count; ++i)
+        if (overlaps(boxes[items[i]]))
+          visit(items[i]);
+    } else {
+      stack.push_back(node.first); // right child after the left one
+      stack.push_back(n + 1);
+    }
+  }
+}
@@ -1,20 +1,21 @@
 #pragma once
+#include "Bvh.hpp"
+#include "Clipper.hpp"
+#include "Framebuffer.hpp"
 #include "Lighting.hpp"
 #include "MatrixKit.hpp"
 #include "Object.hpp"
 #include "Observer.hpp"
+#include "Rasterizer.hpp"
+#include "Stages.hpp"
+#include "Viewport.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#ifndef NO_GLUT // define NO_GLUT for a build that can only render to files
 #include <GL/glut.h>
 
-struct Viewport {
-  double AR, vxl, vxr, vyb, vyt;
-  int win_x, win_y;
-
-  [[nodiscard]] auto get_borders() const {
-    const auto b = [&](const auto& v, const auto win) { return static_cast<int>(std::round((1 + v) * win / 2)); };
-    return std::tuple{b(vxl, win_x), b(vxr, win_x), b(vyb, win_y), b(vyt, win_y)};
-  }
-};
-
 inline auto clear_screen(GLclampf r, GLclampf g, GLclampf b, bool flush = false) {
   glClearColor(r, g, b, 0.0);
   glClear(GL_COLOR_BUFFER_BIT);
@@ -22,120 +23,450 @@ inline auto clear_screen(GLclampf r, GLclampf g, GLclampf b, bool flush = false)
     glFlush();
 }
 
-inline auto flat_shading(const Object& obj, const Observer& ob_ov, const Ambient& ambient, const std::vector<Light>& lights) {
-  const auto [Or, Og, Ob, Kd, Ks, N] = obj.get_lighting_info();
+// what system("pause") does on Windows
+inline auto wait_for_enter() {
+#ifdef _WIN32
+  std::system("pause");
+#else
+  std::cout << "Press Enter to continue . . ." << std::flush;
+  std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+#endif
+}
+#endif
+
+// true if the box lies entirely outside one of the frustum planes, so nothing in it can be seen through pmXem
+inline auto outside_frustum(const Aabb& box, const Matrix<4>& pmXem) {
+  if (box.empty())
+    return true;
+  unsigned char all_out{0xFF};
+  for (const auto& c : box.corners())
+    all_out &= outcode(pmXem * c);
+  return all_out != 0;
+}
+
+// indices of the objects (bvh is built over their bounds) that may be seen through pmXem, in ascending order
+inline auto visible_objects(const Bvh& bvh, const Matrix<4>& pmXem) {
+  std::vector<std::uint32_t> visible;
+  bvh.query([&](const Aabb& box) { return !outside_frustum(box, pmXem); }, [&](std::uint32_t i) { visible.push_back(i); });
+  std::sort(visible.begin(), visible.end()); // keep the script's order, depth ties resolve by it
+  return visible;
+}
+
+// sort object indices by how far the centers of their bounds are from the eye, nearest first
+inline auto sort_front_to_back(std::vector<std::uint32_t>& indices, const std::vector<Object>& objects, const Observer& ob_ov) {
   const auto eye = ob_ov.get_eye_pos();
-  auto ps_au = obj.to_polygons();
-
-  for (auto& poly : ps_au) {
-    const Vector<3> normal{normalize_3D(get_normal(poly.polygon, false))};
-    double Ir{ambient.KaIar * Or}, Ig{ambient.KaIag * Og}, Ib{ambient.KaIab * Ob};
-
-    for (const auto& light : lights) {
-      const auto [NL, HNn] = [&]() {
-        auto L = light.pos() - poly.polygon[0];
-        auto V = eye - poly.polygon[0];
-        auto NL = dot_3D(normal, normalize_3D(L));
-        auto H = normalize_3D(L + V);
-        auto HNn = std::pow(dot_3D(H, normal), N);
-        return NL <= 0.0 ? std::pair{0.0, 0.0} : std::pair{NL, HNn};
-      }();
-
-      Ir += Kd * light.Ipr * NL * Or + Ks * light.Ipr * HNn;
-      Ig += Kd * light.Ipg * NL * Og + Ks * light.Ipg * HNn;
-      Ib += Kd * light.Ipb * NL * Ob + Ks * light.Ipb * HNn;
-    }
-    poly.color = Color{Ir, Ig, Ib};
+  std::vector<real> distance(objects.size());
+  for (const auto i : indices) {
+    const auto c = center_of(objects[i].get_bounds());
+    distance[i] = dot_3D(Vector<4>{{c[0], c[1], c[2], 0}} - eye, Vector<4>{{c[0], c[1], c[2], 0}} - eye);
   }
-  return ps_au;
-}
-
-constexpr auto clip_one_case = [](const Polygon_u<4>& polygon, const auto& c) {
-  Polygon_u<4> relay;
-  const auto sz = polygon.size();
-  for (size_t i = 0; i < sz; ++i) {
-    const auto& s = polygon[i];
-    const auto& p = polygon[(i + 1) % sz];
-    if (const double c1{c(s)}, c2{c(p)}; (c1 >= 0 && c2 >= 0)) { // in2in
-      relay.push_back(p);
-    } else if (const auto new_s = (s + c1 / (c1 - c2) * (p - s)); (c1 >= 0 && c2 < 0)) { // in2out
-      relay.push_back(new_s);
-    } else if (c1 < 0 && c2 >= 0) { // out2in
-      relay.push_back(new_s);
-      relay.push_back(p);
-    }
-  }
-  return relay;
+  std::stable_sort(indices.begin(), indices.end(), [&](std::uint32_t a, std::uint32_t b) { return distance[a] < distance[b]; });
+}
+
+// the world-space ray through window pixel (x, y) where the rasterizer samples it, y counts up from the bottom of the window
+inline auto pixel_ray(int x, int y, const Matrix<4>& pmXem, const Viewport& vp) {
+  const auto to_world = inverse(vp.get_matrix() * pmXem);
+  const auto unproject = [&](real z) {
+    const auto a = to_world * Vector<4>{{static_cast<real>(x), static_cast<real>(y), z, 1}};
+    return Vector<4>{{a[0] / a[3], a[1] / a[3], a[2] / a[3], 1}};
+  };
+  const auto near = unproject(0), far = unproject(1); // depth is 0 on the hither plane and 1 on the yon plane
+  return Ray{near, far - near};
+}
+
+struct Pick {
+  std::uint32_t object, face; // face is numbered as in the object's asc file, not as in its triangulated mesh
 };
 
-inline auto to_screenspace(const Polygons_au& polygons, const Matrix<4>& pmXem) {
-  using Codes = std::array<const std::function<double(const Vector<4>&)>, 6>;
-  const Codes codes{{[](const Vector<4>& v) { return v[3] - v[0]; }, [](const Vector<4>& v) { return v[3] + v[0]; }, // w - x, w + x
-                     [](const Vector<4>& v) { return v[3] - v[1]; }, [](const Vector<4>& v) { return v[3] + v[1]; }, // w - y, w + y
-                     [](const Vector<4>& v) { return v[3] - v[2]; }, [](const Vector<4>& v) { return v[2]; }}};      // w - z, w
-  Polygons_au clipped_polys;
-  std::mutex lock_clipped_polys;
+// the object and face seen at window pixel (x, y), nothing if only the background is.
+// with nobackfaces the faces a display would cull are not hit either, like front_faces decides it
+inline auto pick(const Bvh& bvh, const std::vector<Object>& objects, int x, int y, const Observer& ob_ov, const Viewport& vp, bool nobackfaces)
+    -> std::optional<Pick> {
+  const auto [l, r, b, t] = vp.get_borders();
+  if (x < l || x >= r || y < b || y >= t)
+    return std::nullopt;
+  const auto ray = pixel_ray(x, y, ob_ov.get_pmXem(vp.AR), vp);
+  const auto eye = ob_ov.get_eye_pos();
 
-  std::for_each(std::execution::par_unseq, polygons.begin(), polygons.end(), [&](Polygon_au polygon_au) {
-    polygon_au.polygon = pmXem * polygon_au.polygon; // project a polygon to projection space
+  // ray parameters are in [0, 1] between the hither and yon planes, anything nearer than the best hit so far is still of interest
+  std::optional<Pick> best;
+  real best_t{1};
+  bvh.query(
+      [&](const Aabb& box) {
+        const auto t = intersect(ray, box);
+        return t && *t <= best_t;
+      },
+      [&](std::uint32_t i) {
+        const auto vs = objects[i].get_world_vertices();
+        const auto& is = objects[i].get_indices();
+        const auto& faces = objects[i].get_faces();
+        const auto& source_faces = objects[i].get_mesh().source_faces;
+        for (std::uint32_t f = 0; f < faces.size(); ++f) {
+          const auto& v0 = vs[is[faces[f].first]];
+          if (nobackfaces && dot_3D(get_normal(v0, vs[is[faces[f].first + 1]], vs[is[faces[f].first + 2]], false), eye - v0) <= 0)
+            continue;
+          for (std::uint32_t k = 2; k < faces[f].count; ++k)
+            if (const auto t = intersect(ray, v0, vs[is[faces[f].first + k - 1]], vs[is[faces[f].first + k]]); t && *t < best_t) {
+              best_t = *t;
+              best = Pick{i, source_faces.empty() ? f : source_faces[f]};
+            }
+        }
+      });
+  return best;
+}
+
+// 1 for every face of obj whose front side the eye sees, vs are obj's world vertices
+inline auto front_faces(const Object& obj, const VertexArrays& vs, const Observer& ob_ov) {
+  PROFILE_ZONE("front_faces");
+  const auto eye = ob_ov.get_eye_pos();
+  const auto& is = obj.get_indices();
+  const auto& faces = obj.get_faces();
+  std::vector<unsigned char> front(faces.size());
+
+  std::transform(std::execution::par_unseq, faces.begin(), faces.end(), front.begin(), [&](const Face& face) {
+    const auto& v0 = vs[is[face.first]];
+    return static_cast<unsigned char>(dot_3D(get_normal(v0, vs[is[face.first + 1]], vs[is[face.first + 2]], false), eye - v0) > 0);
+  });
+  return front;
+}
+
+// Phong lighting of obj at the world point p with the unit normal n
+inline auto shade_point(const Object& obj, const Vector<4>& p, const Vector<3>& n, const Vector<4>& eye, const Ambient& ambient,
+                        const std::vector<Light>& lights) {
+  const auto [Or, Og, Ob, Kd, Ks, N] = obj.get_lighting_info();
+  real Ir{ambient.KaIar * Or}, Ig{ambient.KaIag * Og}, Ib{ambient.KaIab * Ob};
+
+  for (const auto& light : lights) {
+    const auto [NL, HNn] = [&]() {
+      auto L = light.pos() - p;
+      auto V = eye - p;
+      auto NL = dot_3D(n, normalize_3D(L));
+      auto H = normalize_3D(L + V);
+      auto HNn = static_cast<real>(std::pow(dot_3D(H, n), N));
+      return NL <= 0 ? std::pair{real{0}, real{0}} : std::pair{NL, HNn};
+    }();
 
-    for (const auto& code : codes) // clip against all six planes
-      polygon_au.polygon = clip_one_case(polygon_au.polygon, code);
+    Ir += Kd * light.Ipr * NL * Or + Ks * light.Ipr * HNn;
+    Ig += Kd * light.Ipg * NL * Og + Ks * light.Ipg * HNn;
+    Ib += Kd * light.Ipb * NL * Ob + Ks * light.Ipb * HNn;
+  }
+  return Color{Ir, Ig, Ib};
+}
 
-    if (polygon_au.polygon.size()) {
-      for (auto& a : polygon_au.polygon) // perspective division
-        a = Vector<4>{{a[0] / a[3], a[1] / a[3], a[2] / a[3], 1.0}};
+// Phong lighting of a face of obj at its first vertex, vs are obj's world vertices
+inline auto shade_face(const Object& obj, const VertexArrays& vs, const Face& face, const Vector<4>& eye, const Ambient& ambient,
+                       const std::vector<Light>& lights) {
+  const auto& is = obj.get_indices();
+  const auto& v0 = vs[is[face.first]];
+  const Vector<3> normal{normalize_3D(get_normal(v0, vs[is[face.first + 1]], vs[is[face.first + 2]], false))};
+  return shade_point(obj, v0, normal, eye, ambient, lights);
+}
+
+// a pixel of obj lit from its interpolated phong attributes
+inline auto shade_pixel(const Object& obj, const Attributes& a, const Vector<4>& eye, const Ambient& ambient, const std::vector<Light>& lights) {
+  return shade_point(obj, Vector<4>{{a[0], a[1], a[2], 1}}, normalize_3D(Vector<4>{{a[3], a[4], a[5], 0}}), eye, ambient, lights);
+}
 
-      std::scoped_lock l{lock_clipped_polys};
-      clipped_polys.push_back(std::move(polygon_au));
+// what smooth shading interpolates at every vertex of obj, vs are obj's world vertices: the lit vertex color for gouraud,
+// the world position and normal for phong
+inline auto vertex_attributes(const Object& obj, const VertexArrays& vs, Shading shading, const Vector<4>& eye, const Ambient& ambient,
+                              const std::vector<Light>& lights) {
+  PROFILE_ZONE("vertex_attributes");
+  const auto ns = obj.get_world_normals();
+  std::vector<Attributes> as(vs.size());
+  parallel_blocks(vs.size(), [&](size_t first, size_t last) {
+    for (auto i = first; i < last; ++i) {
+      if (shading == Shading::phong) {
+        as[i] = Attributes{{vs.x[i], vs.y[i], vs.z[i], ns.x[i], ns.y[i], ns.z[i]}};
+      } else {
+        const auto c = shade_point(obj, vs[i], normalize_3D(ns[i]), eye, ambient, lights);
+        as[i] = Attributes{{c.r, c.g, c.b, 0, 0, 0}};
+      }
     }
-  });
-  return clipped_polys;
+  }, 1024);
+  return as;
+}
+
+// one flat-shaded color per face of obj, vs are obj's world vertices.
+// faces that front (if not empty) marks as hidden are left black
+inline auto flat_shading(const Object& obj, const VertexArrays& vs, const std::vector<unsigned char>& front, const Observer& ob_ov,
+                         const Ambient& ambient, const std::vector<Light>& lights) {
+  PROFILE_ZONE("flat_shading");
+  const auto eye = ob_ov.get_eye_pos();
+  const auto& faces = obj.get_faces();
+  std::vector<Color> colors(faces.size());
+
+  // faces are zipped with front rather than located by address, par_unseq may hand the callable copies of them
+  const auto shade = [&](const Face& face) { return shade_face(obj, vs, face, eye, ambient, lights); };
+  if (front.empty())
+    std::transform(std::execution::par_unseq, faces.begin(), faces.end(), colors.begin(), shade);
+  else
+    std::transform(std::execution::par_unseq, faces.begin(), faces.end(), front.begin(), colors.begin(),
+                   [&](const Face& face, unsigned char seen) { return seen ? shade(face) : Color{}; });
+  return colors;
 }
 
-using Zbuffer = std::array<std::array<double, 500>, 500>;
-using Cbuffer = std::array<std::array<Color, 500>, 500>;
+// a clip-space position with the attributes that are interpolated along with it
+struct SmoothVertex {
+  Vector<4> position;
+  Attributes attributes;
+};
+
+inline auto operator+(const SmoothVertex& a, const SmoothVertex& b) { return SmoothVertex{a.position + b.position, a.attributes + b.attributes}; }
+inline auto operator-(const SmoothVertex& a, const SmoothVertex& b) { return SmoothVertex{a.position - b.position, a.attributes - b.attributes}; }
+inline auto operator*(real s, const SmoothVertex& a) { return SmoothVertex{s * a.position, s * a.attributes}; }
+constexpr const auto& clip_position(const SmoothVertex& v) { return v.position; }
 
-inline void z_buffer_algorithm(const Polygons_au& ps, Zbuffer& zbuf, Cbuffer& cbuf) {
-  auto get_min_max = [](Polygon_u<4> poly, size_t index) {
-    auto [min, max] = std::minmax_element(begin(poly), end(poly), [=](auto a, auto b) { return a[index] < b[index]; });
-    return std::tuple{static_cast<int>(std::trunc((*min)[index])), static_cast<int>(std::ceil((*max)[index]))};
+// divide every clip-space vertex by its w and map it to the viewport (vpm), 1/w is kept in w.
+// summed like Matrix<4> X Vector<4>, so the clipped vertices that to_screen maps one at a time line up exactly
+inline auto to_window(const VertexArrays& vs, const Matrix<4>& vpm) {
+  VertexArrays ret(vs.size());
+  parallel_blocks(vs.size(), [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+      const real x{vs.x[i] / vs.w[i]}, y{vs.y[i] / vs.w[i]}, z{vs.z[i] / vs.w[i]};
+      ret.x[i] = sum_like_row(vpm[0][0] * x, vpm[0][1] * y, vpm[0][2] * z, vpm[0][3]);
+      ret.y[i] = sum_like_row(vpm[1][0] * x, vpm[1][1] * y, vpm[1][2] * z, vpm[1][3]);
+      ret.z[i] = sum_like_row(vpm[2][0] * x, vpm[2][1] * y, vpm[2][2] * z, vpm[2][3]);
+      ret.w[i] = 1 / vs.w[i];
+    }
+  });
+  return ret;
+}
+
+// project, clip, divide and map the faces of obj to the viewport (vpm), colors has one entry per face or none at all,
+// attributes one per vertex or none at all. faces that front (if not empty) marks as hidden are skipped.
+// the polygons outlive the display and come from the heap, the per-face bookkeeping from memory
+inline auto to_screenspace(const Object& obj, const std::vector<unsigned char>& front, const std::vector<Color>& colors,
+                           const std::vector<Attributes>& attributes, const Matrix<4>& pmXem, const Matrix<4>& vpm, std::pmr::memory_resource* memory) {
+  PROFILE_ZONE("to_screenspace");
+  const auto to_screen = [&](const Vector<4>& a) {
+    auto s = vpm * Vector<4>{{a[0] / a[3], a[1] / a[3], a[2] / a[3], 1.0}};
+    s[3] = 1 / a[3];
+    return s;
   };
+  const auto& is = obj.get_indices();
+  const auto& faces = obj.get_faces();
+  StageTimer timer{Stage::transform};
 
-  auto is_in_poly = [](int x, int y, const Polygon_u<4>& poly, auto normal) {
-    for (size_t i = 0, sz = poly.size(); i != sz; ++i)
-      if (cross_Z((poly[(i + 1) % sz] - poly[i]), (Vector<4>{double(x), double(y), 0.0, 0.0} - poly[i])) * normal[2] < 0.0)
-        return false;
-    return true;
+  // place and project every vertex once and record the planes it lies outside of, faces share the results by index.
+  // vertices outside some plane get window coordinates too, but only clipped copies of them are ever used
+  const auto projected = (pmXem * obj.get_transform()) * obj.get_mesh().vertices;
+  const auto codes = outcodes(projected, memory);
+  ScreenPolygons ps;
+  ps.vertices = to_window(projected, vpm);
+  ps.attributes.resize(attributes.size());
+  std::transform(std::execution::par_unseq, attributes.begin(), attributes.end(), ps.vertices.w.begin(), ps.attributes.begin(),
+                 [](const Attributes& a, real inv_w) { return inv_w * a; });
+
+  // the planes every face crosses, or gone if it is hidden or every vertex is outside the same plane
+  timer.next(Stage::clip);
+  constexpr unsigned char gone{0xFF};
+  std::pmr::vector<unsigned char> planes(faces.size(), memory);
+  const auto crossed = [&](const Face& face) {
+    unsigned char all_out{0xFF}, any_out{0};
+    for (auto i = is.begin() + face.first; i != is.begin() + face.first + face.count; ++i) {
+      all_out &= codes[*i];
+      any_out |= codes[*i];
+    }
+    return all_out ? gone : any_out;
   };
+  if (front.empty())
+    std::transform(std::execution::par_unseq, faces.begin(), faces.end(), planes.begin(), crossed);
+  else
+    std::transform(std::execution::par_unseq, faces.begin(), faces.end(), front.begin(), planes.begin(),
+                   [&](const Face& face, unsigned char seen) { return seen ? crossed(face) : gone; });
 
-  for (const auto& p : ps) {
-    const Vector<3> normal{normalize_3D(get_normal(p.polygon))};
-    const auto [A, B, C] = normal;
-    const double D = -(dot_3D(Vector<3>{A, B, C}, Vector<3>{p.polygon[0][0], p.polygon[0][1], p.polygon[0][2]}));
-
-    for (auto [y, y_max] = get_min_max(p.polygon, 1); y != y_max; ++y) {
-      auto [x, x_max] = get_min_max(p.polygon, 0);
-      for (double z = -(A * x + B * y + D) / C; x != x_max; ++x, z -= A / C) {
-        if (z < zbuf[y][x] && is_in_poly(x, y, p.polygon, normal)) {
-          zbuf[y][x] = z;
-          cbuf[y][x] = p.color;
-        }
+  // only the faces that cross a plane get their own vertices, clipped with the attributes since those are linear in clip space
+  std::pmr::vector<std::uint32_t> crossing{memory};
+  crossing.reserve(std::count_if(planes.begin(), planes.end(), [](unsigned char p) { return p != gone && p; }));
+  for (std::uint32_t f = 0; f < faces.size(); ++f)
+    if (planes[f] != gone && planes[f])
+      crossing.push_back(f);
+  std::pmr::vector<ClipPolygon<SmoothVertex>> clipped(crossing.size(), memory);
+  std::transform(std::execution::par, crossing.begin(), crossing.end(), clipped.begin(), [&](std::uint32_t f) {
+    ClipPolygon<SmoothVertex> polygon;
+    for (auto i = is.begin() + faces[f].first; i != is.begin() + faces[f].first + faces[f].count; ++i)
+      polygon.push_back(SmoothVertex{projected[*i], attributes.empty() ? Attributes{} : attributes[*i]});
+    return clip_polygon(polygon, planes[f]);
+  });
+
+  // lay the surviving polygons out in face order, every clipped one gets a run of new vertices after the mesh's
+  constexpr auto unclipped = std::numeric_limits<std::uint32_t>::max();
+  std::pmr::vector<std::uint32_t> slot{memory};      // per polygon, which entry of clipped it is or unclipped
+  std::pmr::vector<std::uint32_t> first_new{memory}; // per polygon, where its new vertices start
+  slot.reserve(faces.size());
+  first_new.reserve(faces.size());
+  auto vertex_count = static_cast<std::uint32_t>(ps.vertices.size());
+  for (std::uint32_t f = 0, c = 0; f < faces.size(); ++f) {
+    if (planes[f] == gone)
+      continue;
+    const auto s = planes[f] ? c++ : unclipped;
+    const auto count = s == unclipped ? faces[f].count : static_cast<std::uint32_t>(clipped[s].size());
+    if (count == 0)
+      continue;
+    ps.faces.push_back(f);
+    ps.offsets.push_back(ps.offsets.back() + count);
+    slot.push_back(s);
+    first_new.push_back(vertex_count);
+    if (s != unclipped)
+      vertex_count += count;
+  }
+  PROFILE_COUNT(Counter::polygons_in, faces.size());
+  PROFILE_COUNT(Counter::polygons_clipped_away, faces.size() - ps.size() - (front.empty() ? 0 : std::count(front.begin(), front.end(), 0)));
+  PROFILE_COUNT(Counter::clip_vertices, vertex_count - projected.size());
+  if (!colors.empty()) {
+    ps.colors.resize(ps.faces.size());
+    std::transform(ps.faces.begin(), ps.faces.end(), ps.colors.begin(), [&](std::uint32_t f) { return colors[f]; });
+  }
+
+  ps.indices.resize(ps.offsets.back());
+  ps.vertices.resize(vertex_count);
+  if (!attributes.empty())
+    ps.attributes.resize(vertex_count);
+  parallel_blocks(ps.size(), [&](size_t first, size_t last) {
+    for (auto p = first; p < last; ++p) {
+      auto out = ps.indices.begin() + ps.offsets[p];
+      if (slot[p] == unclipped) { // entirely inside, index the shared screen-space vertices
+        const auto& face = faces[ps.faces[p]];
+        std::copy(is.begin() + face.first, is.begin() + face.first + face.count, out);
+        continue;
+      }
+      auto v = first_new[p];
+      for (const auto& a : clipped[slot[p]]) {
+        const auto s = to_screen(a.position);
+        ps.vertices.set(v, s);
+        if (!attributes.empty())
+          ps.attributes[v] = s[3] * a.attributes;
+        *out++ = v++;
       }
     }
+  }, 1024);
+  return ps;
+}
+
+// shaded screen-space polygons of obj, reusing what the previous display cached for it as far as key allows.
+// flat polygons are colored unless key is deferred, smooth ones carry per-vertex attributes instead. scratch comes from memory,
+// the cache is the one of slot
+inline const ScreenPolygons& screen_polygons(const Object& obj, const DisplayKey& key, const Ambient& ambient, const std::vector<Light>& lights,
+                                             std::pmr::memory_resource* memory, size_t slot = 0) {
+  auto& cache = obj.get_cache(slot);
+  if (cache.key && *cache.key == key)
+    return cache.polygons;
+
+  const bool moved{!cache.key || !(cache.key->ob_ov == key.ob_ov) || cache.key->nobackfaces != key.nobackfaces};
+  if (moved || cache.key->deferred != key.deferred || cache.key->shading != key.shading || cache.key->lighting_version != key.lighting_version) {
+    const StageTimer timer{Stage::shade};
+    const auto vs = obj.get_world_vertices();
+    if (moved)
+      cache.front = key.nobackfaces ? front_faces(obj, vs, key.ob_ov) : std::vector<unsigned char>{};
+    const bool flat{key.shading == Shading::flat};
+    cache.colors = !flat || key.deferred ? std::vector<Color>{} : flat_shading(obj, vs, cache.front, key.ob_ov, ambient, lights);
+    cache.attributes = flat ? std::vector<Attributes>{} : vertex_attributes(obj, vs, key.shading, key.ob_ov.get_eye_pos(), ambient, lights);
   }
+  cache.polygons = to_screenspace(obj, cache.front, cache.colors, cache.attributes, key.ob_ov.get_pmXem(key.vp.AR), key.vp.get_matrix(), memory);
+  cache.key = key;
+  return cache.polygons;
 }
 
-inline void draw(const Cbuffer& cbuf, const Viewport& vp) {
+// payload(b, ps, p) is what flat polygon p of batch b (ps) leaves in the color plane where it is visible,
+// shade(b, attributes) what a visible pixel of a smooth polygon of batch b does. triangles and bins come from memory
+template<typename Depth, typename Payload, typename Shade>
+inline void z_buffer_algorithm(const PolygonBatches& ps, Framebuffer<Depth>& fb, std::pmr::memory_resource* memory, Payload payload, Shade shade) {
+  PROFILE_ZONE("z_buffer_algorithm");
+  const auto setup = setup_triangles(ps, payload, memory);
+  rasterize_tiles(setup, bin_triangles(setup.triangles, fb.get_width(), fb.get_height(), memory), fb, shade);
+}
+
+// smooth polygons are taken as gouraud shaded, their attributes hold the color
+template<typename Depth, typename Payload>
+inline void z_buffer_algorithm(const PolygonBatches& ps, Framebuffer<Depth>& fb, std::pmr::memory_resource* memory, Payload payload) {
+  z_buffer_algorithm(ps, fb, memory, payload, [](size_t, const Attributes& a) { return pack_rgba(Color{a[0], a[1], a[2]}); });
+}
+
+template<typename Depth>
+inline void z_buffer_algorithm(const PolygonBatches& ps, Framebuffer<Depth>& fb, std::pmr::memory_resource* memory) {
+  z_buffer_algorithm(ps, fb, memory, [](size_t, const ScreenPolygons& ps, std::uint32_t p) { return pack_rgba(ps.colors[p]); });
+}
+
+// the second half of a deferred display: fb's color plane holds face IDs, 0 where nothing was drawn and first_id[b] + f + 1
+// where face f of objects[visible[b]] is visible. every visible face is lit once, then the IDs are replaced by colors.
+// the lookup tables come from memory
+template<typename Depth>
+inline void deferred_shading(Framebuffer<Depth>& fb, const std::vector<Object>& objects, const std::vector<std::uint32_t>& visible,
+                             const std::vector<std::uint32_t>& first_id, const Observer& ob_ov, const Ambient& ambient, const std::vector<Light>& lights,
+                             std::uint32_t background, std::pmr::memory_resource* memory) {
+  PROFILE_ZONE("deferred_shading");
+  std::pmr::vector<unsigned char> seen(first_id.back() + size_t{1}, memory);
+  for (int y = 0; y < fb.get_height(); ++y)
+    for (auto row = fb.color_row(y), x = row; x != row + fb.get_width(); ++x)
+      seen[*x] = 1;
+
+  std::pmr::vector<std::uint32_t> rgba(seen.size(), memory);
+  rgba[0] = background;
+  const auto eye = ob_ov.get_eye_pos();
+  std::pmr::vector<std::uint32_t> face_indices{memory};
+  for (size_t b = 0; b < visible.size(); ++b) {
+    const auto first = seen.begin() + first_id[b] + 1, last = seen.begin() + first_id[b + 1] + 1;
+    if (std::find(first, last, 1) == last)
+      continue;
+    const auto& obj = objects[visible[b]];
+    const auto vs = obj.get_world_vertices();
+    const auto& faces = obj.get_faces();
+    face_indices.resize(faces.size());
+    std::iota(face_indices.begin(), face_indices.end(), 0u);
+    std::for_each(std::execution::par_unseq, face_indices.begin(), face_indices.end(), [&](std::uint32_t f) {
+      if (const auto id = first_id[b] + f + 1; seen[id])
+        rgba[id] = pack_rgba(shade_face(obj, vs, faces[f], eye, ambient, lights));
+    });
+  }
+
+  std::pmr::vector<int> rows(fb.get_height(), memory);
+  std::iota(rows.begin(), rows.end(), 0);
+  std::for_each(std::execution::par_unseq, rows.begin(), rows.end(), [&](int y) {
+    const auto row = fb.color_row(y);
+    std::transform(row, row + fb.get_width(), row, [&](std::uint32_t id) { return rgba[id]; });
+  });
+}
+
+#ifndef NO_GLUT
+// push the viewport region of the color buffer to the window in one glDrawPixels call
+template<typename Depth>
+inline void draw(const Framebuffer<Depth>& fb, const Viewport& vp) {
+  PROFILE_ZONE("draw");
+  const auto [vxl, vxr, vyb, vyt] = vp.get_borders();
+
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, fb.get_width());
+  glRasterPos2i(vxl, vyb);
+  glDrawPixels(vxr - vxl, vyt - vyb, GL_RGBA, GL_UNSIGNED_BYTE, fb.color_row(vyb) + vxl);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glFlush();
+}
+#endif
+
+// write the whole window as a binary PPM, pixels outside the viewport are black. frames written one after another make a PPM stream
+template<typename Depth>
+inline auto write_ppm(const Framebuffer<Depth>& fb, const Viewport& vp, std::ostream& ppm) {
+  PROFILE_ZONE("write_ppm");
   const auto [vxl, vxr, vyb, vyt] = vp.get_borders();
 
-  glBegin(GL_POINTS);
-  for (auto y = vyb; y < vyt; ++y) {
-    for (auto x = vxl; x < vxr; ++x) {
-      glColor3d(cbuf[y][x].r, cbuf[y][x].g, cbuf[y][x].b);
-      glVertex2i(x, y);
+  ppm << "P6\n"
+      << fb.get_width() << ' ' << fb.get_height() << "\n255\n";
+  std::vector<char> line(static_cast<size_t>(fb.get_width()) * 3);
+  for (auto y = fb.get_height() - 1; y >= 0; --y) { // PPM goes top to bottom
+    const auto row = fb.color_row(y);
+    for (auto x = 0; x < fb.get_width(); ++x) {
+      const bool inside{x >= vxl && x < vxr && y >= vyb && y < vyt};
+      line[3 * x] = inside ? red_of(row[x]) : 0;
+      line[3 * x + 1] = inside ? green_of(row[x]) : 0;
+      line[3 * x + 2] = inside ? blue_of(row[x]) : 0;
     }
+    ppm.write(line.data(), line.size());
   }
-  glEnd();
-  glFlush();
+  return static_cast<bool>(ppm);
+}
+
+template<typename Depth>
+inline auto write_ppm(const Framebuffer<Depth>& fb, const Viewport& vp, const std::string& path) {
+  std::ofstream ppm{path, std::ios::binary};
+  return write_ppm(fb, vp, ppm);
 }
@@ -0,0 +1,46 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+
+// scratch memory for one display: a bump allocator over a single block that is rewound, not freed, when the display ends.
+// a display that does not fit borrows the rest from the heap, and the block grows to hold all of it before the next display.
+// deallocation does nothing, so containers should be sized up front where possible. not thread safe, allocate outside parallel loops
+class FrameArena : public std::pmr::memory_resource {
+  std::unique_ptr<std::byte[]> block;
+  size_t capacity{0};
+  size_t used{0};
+  size_t overflowed{0}; // bytes asked of the heap since the last rewind
+  std::pmr::monotonic_buffer_resource overflow{std::pmr::new_delete_resource()};
+
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    const auto base = reinterpret_cast<std::uintptr_t>(block.get());
+    const auto first = (base + used + alignment - 1) / alignment * alignment - base;
+    if (block && first + bytes <= capacity) {
+      used = first + bytes;
+      return block.get() + first;
+    }
+    overflowed += bytes + alignment;
+    return overflow.allocate(bytes, alignment);
+  }
+  void do_deallocate(void*, size_t, size_t) override {}
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+public:
+  explicit FrameArena(size_t initial_capacity = 1 << 20) : block{std::make_unique<std::byte[]>(initial_capacity)}, capacity{initial_capacity} {}
+  FrameArena(const FrameArena&) = delete;
+  FrameArena& operator=(const FrameArena&) = delete;
+
+  // forget everything allocated so far, whatever is still using it must be gone
+  void rewind() {
+    if (overflowed) {
+      capacity = std::max(capacity * 2, capacity + overflowed);
+      block = std::make_unique<std::byte[]>(capacity);
+      overflow.release();
+      overflowed = 0;
+    }
+    used = 0;
+  }
+};
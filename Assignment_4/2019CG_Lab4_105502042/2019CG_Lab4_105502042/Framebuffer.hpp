@@ -0,0 +1,99 @@
+#pragma once
+#include "Lighting.hpp"
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+
+// depth is either a float or a 24-bit unsigned fixed point number stored in a uint32_t
+template<typename Depth>
+struct DepthTraits;
+
+template<>
+struct DepthTraits<float> {
+  static constexpr float far{std::numeric_limits<float>::max()};
+  static auto encode(real z) { return static_cast<float>(z); }
+};
+
+template<>
+struct DepthTraits<std::uint32_t> {
+  static constexpr std::uint32_t far{0xFF'FFFF};
+  // z is in [0, 1] after perspective division, clamp the plane equation's overshoot
+  static auto encode(real z) { return static_cast<std::uint32_t>(std::clamp(z, real{0}, real{1}) * far); }
+};
+
+// pack a color into RGBA8, r in the lowest byte so the bytes are laid out as R, G, B, A on little-endian machines
+inline auto pack_rgba(const Color& c) {
+  const auto to_byte = [](real a) { return static_cast<std::uint32_t>(std::round(std::clamp(a, real{0}, real{1}) * 255.0)); };
+  return to_byte(c.r) | to_byte(c.g) << 8 | to_byte(c.b) << 16 | 0xFFu << 24;
+}
+
+constexpr auto red_of(std::uint32_t rgba) { return static_cast<unsigned char>(rgba); }
+constexpr auto green_of(std::uint32_t rgba) { return static_cast<unsigned char>(rgba >> 8); }
+constexpr auto blue_of(std::uint32_t rgba) { return static_cast<unsigned char>(rgba >> 16); }
+
+// define DEPTH24 to trade float depth for 24-bit fixed point
+#ifdef DEPTH24
+using default_depth = std::uint32_t;
+#else
+using default_depth = float;
+#endif
+
+// depth plane and RGBA8 color plane of a window, both live in one cache-line aligned allocation
+template<typename Depth = default_depth>
+class Framebuffer {
+  static constexpr size_t alignment{64};
+
+  struct AlignedDelete {
+    void operator()(std::byte* p) const { ::operator delete[](p, std::align_val_t{alignment}); }
+  };
+
+  int width{0};
+  int height{0};
+  std::unique_ptr<std::byte[], AlignedDelete> storage;
+  Depth* depth_plane{nullptr};
+  std::uint32_t* color_plane{nullptr};
+
+public:
+  using depth_type = Depth;
+
+  Framebuffer() = default;
+  explicit Framebuffer(int w, int h) { resize(w, h); }
+
+  // reallocates only when the size actually changes
+  auto resize(int w, int h);
+
+  // bulk fill both planes
+  auto clear(std::uint32_t rgba, Depth depth = DepthTraits<Depth>::far);
+
+  auto get_width() const { return width; }
+  auto get_height() const { return height; }
+
+  auto depth_row(int y) { return depth_plane + static_cast<size_t>(y) * width; }
+  auto color_row(int y) { return color_plane + static_cast<size_t>(y) * width; }
+  auto depth_row(int y) const { return static_cast<const Depth*>(depth_plane + static_cast<size_t>(y) * width); }
+  auto color_row(int y) const { return static_cast<const std::uint32_t*>(color_plane + static_cast<size_t>(y) * width); }
+
+private:
+  static constexpr auto round_up(size_t n) { return (n + alignment - 1) / alignment * alignment; }
+};
+
+template<typename Depth>
+inline auto Framebuffer<Depth>::resize(int w, int h) {
+  if (w == width && h == height)
+    return;
+  const auto pixels = static_cast<size_t>(w) * h;
+  const auto depth_bytes = round_up(pixels * sizeof(Depth));
+  storage.reset(static_cast<std::byte*>(::operator new[](depth_bytes + round_up(pixels * sizeof(std::uint32_t)), std::align_val_t{alignment})));
+  depth_plane = reinterpret_cast<Depth*>(storage.get());
+  color_plane = reinterpret_cast<std::uint32_t*>(storage.get() + depth_bytes);
+  width = w;
+  height = h;
+}
+
+template<typename Depth>
+inline auto Framebuffer<Depth>::clear(std::uint32_t rgba, Depth depth) {
+  const auto pixels = static_cast<size_t>(width) * height;
+  std::fill_n(std::execution::par_unseq, depth_plane, pixels, depth);
+  std::fill_n(std::execution::par_unseq, color_plane, pixels, rgba);
+}
@@ -1,212 +1,118 @@
-#include "DrawKit.hpp"
-#include "Object.hpp"
-#include "Observer.hpp"
+#include "Renderer.hpp"
+#include "Scene.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+#include <tuple>
+#include <vector>
 
-std::ifstream in_file;
 int win_x, win_y;
+std::istream* script{&std::cin};
+std::filesystem::path script_dir;
+std::ostream* text_out{&std::cout}; // std::cerr while frames are streamed to std::cout
+std::string trace_path;             // where the zones and counters of a PROFILE build go when the program ends
 
-auto process_background(std::stringstream& ss) {
-  double Br, Bg, Bb;
-  ss >> Br >> Bg >> Bb;
-  return Background{Br, Bg, Bb};
-}
-
-auto process_ambient(std::stringstream& ss) {
-  double KaIar, KaIag, KaIab;
-  ss >> KaIar >> KaIag >> KaIab;
-  return Ambient{KaIar, KaIag, KaIab};
-}
-
-auto process_light(std::stringstream& ss, std::vector<Light>& lights) {
-  size_t index;
-  double Ipr, Ipg, Ipb, Ix, Iy, Iz;
-  ss >> index >> Ipr >> Ipg >> Ipb >> Ix >> Iy >> Iz;
-  if (index > lights.size())
-    lights.push_back(Light{Ipr, Ipg, Ipb, Ix, Iy, Iz});
-  else
-    lights[index - 1] = Light{Ipr, Ipg, Ipb, Ix, Iy, Iz};
-}
-
-auto process_scale(std::stringstream& ss) {
-  double x, y, z;
-  ss >> x >> y >> z;
-  return scaling_m(x, y, z);
-}
-
-auto process_rotate(std::stringstream& ss) {
-  double x, y, z;
-  ss >> x >> y >> z;
-  if (x)
-    return rotation_m(x, 'x');
-  else if (y)
-    return rotation_m(y, 'y');
-  else
-    return rotation_m(z);
-}
-
-auto process_translate(std::stringstream& ss) {
-  double x, y, z;
-  ss >> x >> y >> z;
-  return translation_m(x, y, z);
-}
+auto print_line(const std::string& line) { *text_out << line; }
 
-auto process_viewport(std::stringstream& ss) {
-  double vxl, vxr, vyb, vyt;
-  ss >> vxl >> vxr >> vyb >> vyt;
-  return Viewport{(vxr - vxl) / (vyt - vyb), vxl, vxr, vyb, vyt, win_x, win_y};
+#ifndef NO_GLUT
+auto displayFunc() {
+  MeshRegistry meshes;
+  const auto show = [](const Framebuffer<>& fb, const Viewport& vp) {
+    clear_screen(0.0f, 0.0f, 0.0f);
+    draw(fb, vp);
+    wait_for_enter();
+    return true;
+  };
+  Scene scene{win_x, win_y, meshes, show, print_line, script_dir};
+  scene.run(*script);
+  if (scene.has_ended())
+    exit(EXIT_SUCCESS);
 }
+#endif
 
-auto process_object(std::stringstream& ss, const Matrix<4>& TM) {
-  // open asc file
-  std::string asc_path;
-  double Or, Og, Ob, Kd, Ks;
-  int N;
-  ss >> asc_path >> Or >> Og >> Ob >> Kd >> Ks >> N;
+auto main(int argc, char* argv[]) -> int {
+  std::ios_base::sync_with_stdio(false);
 
-  std::ifstream asc_file{asc_path};
-  if (!asc_file) {
-    asc_path = "../Debug/" + asc_path;
-    asc_file.open(asc_path);
+  // an output prefix renders out/frame_0.ppm, out/frame_1.ppm... without a window, --stages prints how long each stage of the
+  // pipeline took once the script is done, --trace saves what a PROFILE build recorded as Chrome trace events.
+  // script - reads the script from stdin as it arrives, output prefix - streams the frames to stdout as PPMs.
+  // --batch renders every script on its own to out/<script name>_0.ppm..., n at a time (one per core by default)
+  constexpr auto usage = "usage: Lab4 script.in [out/frame_] [--stages] [--trace trace.json]\n"
+                         "       Lab4 --batch out/ [--jobs n] script.in... [--stages] [--trace trace.json]\n";
+  bool stages{false};
+  std::optional<std::filesystem::path> batch_dir;
+  unsigned jobs{std::thread::hardware_concurrency()};
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    if (const std::string_view arg{argv[i]}; arg == "--stages") {
+      stages = true;
+    } else if (arg == "--trace" && i + 1 < argc) {
+      trace_path = argv[++i];
+    } else if (arg == "--batch" && i + 1 < argc) {
+      batch_dir = argv[++i];
+    } else if (arg == "--jobs" && i + 1 < argc) {
+      jobs = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+    } else if (arg.rfind("--", 0) == 0) { // unknown, or an option without its value
+      std::cerr << usage;
+      return EXIT_FAILURE;
+    } else {
+      args.emplace_back(arg);
+    }
   }
-
-  // read it
-  std::string line;
-  std::getline(asc_file, line);
-  if (line == "")
-    std::getline(asc_file, line);
-  std::stringstream asc_ss;
-  asc_ss << line;
-  size_t v, f;
-  asc_ss >> v >> f;
-
-  Object asc_obj{v, f, Or, Og, Ob, Kd, Ks, N};
-  asc_obj.set_vertex(asc_ss, asc_file, TM);
-  asc_obj.set_face(asc_ss, asc_file);
-
-  return asc_obj;
-}
-
-auto process_observer(std::stringstream& ss) {
-  double Ex, Ey, Ez, COIx, COIy, COIz, Tilt, Hither, Yon, Hav;
-  ss >> Ex >> Ey >> Ez >> COIx >> COIy >> COIz >> Tilt >> Hither >> Yon >> Hav;
-  return Observer{Ex, Ey, Ez, COIx, COIy, COIz, Tilt, Hither, Yon, Hav};
-}
-
-auto process_display(const Viewport& vp, const std::vector<Object>& objects, const Observer& ob_ov,
-                     const Background& bg, const Ambient& ambient, const std::vector<Light>& lights) {
-
-  auto t0 = std::chrono::high_resolution_clock::now();
-
-  clear_screen(0.0f, 0.0f, 0.0f);
-
-  const Polygons_au ps_illuminated = [&]() {
-    Polygons_au ret, a;
-    for (const auto& obj : objects) {
-      a = flat_shading(obj, ob_ov, ambient, lights);
-      ret.insert(ret.end(), a.begin(), a.end());
+  const bool stream_frames{!batch_dir && args.size() >= 2 && args[1] == "-"};
+  if (stream_frames)
+    text_out = &std::cerr;
+  if (stages)
+    std::atexit([] { print_stages(*text_out); });
+  if (!trace_path.empty() && !profile_enabled)
+    std::cerr << "--trace needs a build with PROFILE defined\n";
+  else if (!trace_path.empty())
+    std::atexit([] {
+      if (!write_trace(trace_path))
+        std::cerr << "cannot write " << trace_path << '\n';
+    });
+
+  if (batch_dir) {
+    if (std::error_code ec; std::filesystem::create_directories(*batch_dir, ec), ec) {
+      std::cerr << "cannot create " << batch_dir->string() << ": " << ec.message() << '\n';
+      return EXIT_FAILURE;
     }
-    return ret;
-  }();
-
-  std::unique_ptr<Cbuffer> cbuf{new Cbuffer};
-  for (auto& arr : (*cbuf))
-    arr.fill(Color{bg.Br, bg.Bg, bg.Bb});
-
-  std::unique_ptr<Zbuffer> zbuf{new Zbuffer};
-  for (auto& arr : (*zbuf))
-    arr.fill(std::numeric_limits<double>::max());
-
-  const auto [vxl, vxr, vyb, vyt] = vp.get_borders();
-  z_buffer_algorithm(translation_m(vxl, vyb) *
-                         scaling_m((vxr - vxl) / 2.0, (vyt - vyb) / 2.0) *
-                         translation_m(1.0, 1.0) *
-                         to_screenspace(ps_illuminated, ob_ov.get_pmXem(vp.AR)),
-                     *zbuf, *cbuf);
-
-  draw(*cbuf, vp);
-
-  auto t1 = std::chrono::high_resolution_clock::now();
-  std::cout << "display takes: " << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() << "ms\n";
-  system("pause");
-}
-
-// some hash function found on the Internet. I need a constexpr hash function.
-constexpr size_t fnv1a_32(char const* s, std::size_t count) {
-#pragma warning(disable : 4307)
-  return ((count ? fnv1a_32(s, count - 1) : 2166136261U) ^ s[count]) * 16777619U;
-}
-constexpr size_t operator""_hash(char const* s, const size_t count) { return fnv1a_32(s, count); }
-
-auto displayFunc() {
-  std::stringstream ss;
-  Matrix<4> TM{identity_matrix};
-  Viewport vp;
-  Observer ob_ov;
-  std::vector<Object> objects;
-  Background background;
-  Ambient ambient;
-  std::vector<Light> lights;
-
-  for (std::string line, str; std::getline(in_file, line);) {
-    while (ss >> str)
-      ;
-    str.clear();
-    ss.clear();
-    ss << line;
-    ss >> str;
-    switch (operator""_hash(str.c_str(), str.size())) {
-    case "scale"_hash:
-      TM = process_scale(ss) * TM;
-      break;
-    case "rotate"_hash:
-      TM = process_rotate(ss) * TM;
-      break;
-    case "translate"_hash:
-      TM = process_translate(ss) * TM;
-      break;
-    case "viewport"_hash:
-      vp = process_viewport(ss);
-      break;
-    case "object"_hash:
-      objects.push_back(process_object(ss, TM));
-      break;
-    case "observer"_hash:
-      ob_ov = process_observer(ss);
-      break;
-    case "display"_hash:
-      process_display(vp, objects, ob_ov, background, ambient, lights);
-      break;
-    case "ambient"_hash:
-      ambient = process_ambient(ss);
-      break;
-    case "background"_hash:
-      background = process_background(ss);
-      break;
-    case "light"_hash:
-      process_light(ss, lights);
-      break;
-    case "end"_hash:
-      exit(EXIT_SUCCESS);
-      [[fallthrough]];
-    case "reset"_hash:
-      TM = identity_matrix;
-    case ""_hash: // newlines fall into this case
-    case "#"_hash:
-      break;
-    } // catches all cases no default!
+    Renderer renderer{std::cout, jobs};
+    std::vector<std::future<bool>> done;
+    for (const auto& path : args)
+      done.push_back(renderer.submit(path, (*batch_dir / std::filesystem::path{path}.stem()).string() + '_'));
+    bool failed{false};
+    for (auto& d : done)
+      failed |= !d.get();
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
   }
-}
 
-auto main(int argc, char* argv[]) -> int {
-  std::ios_base::sync_with_stdio(false);
-  in_file.open(((argc == 2) ? argv[1] : "../Debug/lab4B.in")); // Lab3A.in, simple.in...
-  if (!in_file)
+  std::ifstream in_file;
+  const std::string path{args.empty() ? "../Debug/lab4B.in" : args[0]};
+  if (path != "-") {
+    in_file.open(path);
+    script = &in_file;
+    script_dir = std::filesystem::path{path}.parent_path();
+  }
+  const auto size = read_window_size(*script);
+  if (!size)
     return -1;
-  std::string line;
-  std::getline(in_file, line);
-  std::stringstream ss{line};
-  ss >> win_x >> win_y;
-  system("pause");
+  std::tie(win_x, win_y) = *size;
+
+  if (args.size() >= 2) {
+    // the next display's geometry overlaps writing out the previous one given a second core. the window does not pipeline,
+    // and --batch already keeps every core busy with whole scripts
+    MeshRegistry meshes;
+    const bool pipelined{std::thread::hardware_concurrency() > 1};
+    Scene scene{win_x, win_y, meshes, stream_frames ? ppm_stream(std::cout) : ppm_files(args[1], print_line), print_line, script_dir, pipelined};
+    return scene.run(*script) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+#ifdef NO_GLUT
+  std::cerr << "this build has no window, pass an output prefix after the script\n";
+  return EXIT_FAILURE;
+#else
+  wait_for_enter();
   std::cout << "display takes about 2 seconds in DEBUG MODE, \n       less than 30 milliseconds in RELEASE MODE.\nPatience is a virtue!\n\n";
 
   // GLUT stuff
@@ -223,4 +129,5 @@ auto main(int argc, char* argv[]) -> int {
   gluOrtho2D(0.0, win_x, 0.0, win_y);
   glFlush();
   glutMainLoop();
+#endif
 }
@@ -1,33 +1,41 @@
 #pragma once
 #include "MatrixKit.hpp"
+#include <cstdint>
 
 struct Color {
-  double r, g, b;
+  real r, g, b;
 };
 
 struct Background {
-  double Br{0.0}, Bg{0.0}, Bb{0.0};
+  real Br{0.0}, Bg{0.0}, Bb{0.0};
 };
 
 struct Ambient {
-  double KaIar, KaIag, KaIab;
+  real KaIar, KaIag, KaIab;
 };
 
 struct Light {
-  double Ipr, Ipg, Ipb, Ix, Iy, Iz;
+  real Ipr, Ipg, Ipb, Ix, Iy, Iz;
   auto pos() const { return Vector<4>{Ix, Iy, Iz, 0.0}; }
 };
 
-struct Polygon_au {
-  Polygon_u<4> polygon;
-  Color color;
-};
+// flat shading lights a face once, gouraud lights every vertex and phong every pixel
+enum class Shading { flat, gouraud, phong };
+
+// what smooth shading interpolates across a polygon: the vertex color (gouraud) or the world position and normal (phong)
+constexpr size_t attribute_count{6};
+using Attributes = Vector<attribute_count>;
 
-using Polygons_au = std::vector<Polygon_au>;
+// the polygons an object leaves in screen space, stored CSR style: polygon p is made of the vertices
+// indices[offsets[p]], ..., indices[offsets[p + 1] - 1]. unclipped polygons index the projected mesh vertices directly,
+// clipping appends new vertices after those
+struct ScreenPolygons {
+  VertexArrays vertices;              // window coordinates and depth, 1/w in w
+  std::vector<Attributes> attributes; // one per vertex divided by its clip-space w, empty for flat shading
+  std::vector<std::uint32_t> indices;
+  std::vector<std::uint32_t> offsets{0};
+  std::vector<std::uint32_t> faces; // which face of its object each polygon came from
+  std::vector<Color> colors;        // one per polygon, empty unless they are flat shaded in advance
 
-// apply a transformation to a vector of vertices
-inline auto operator*(const Matrix<4>& t, const Polygons_au& ps) {
-  Polygons_au ret{ps.size()};
-  std::transform(std::execution::par_unseq, ps.begin(), ps.end(), ret.begin(), [&](const Polygon_au& vs) { return Polygon_au{t * vs.polygon, vs.color}; });
-  return ret;
-}
+  auto size() const { return offsets.size() - 1; }
+};
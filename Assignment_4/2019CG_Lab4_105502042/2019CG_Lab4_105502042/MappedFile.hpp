@@ -0,0 +1,75 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <utility>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// a whole file mapped read-only into memory, false if it cannot be opened or is empty
+class MappedFile {
+  const char* data{nullptr};
+  size_t size{0};
+
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string& path);
+  MappedFile(MappedFile&& other) noexcept : data{std::exchange(other.data, nullptr)}, size{std::exchange(other.size, 0)} {}
+  MappedFile& operator=(MappedFile&& other) noexcept {
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+    return *this;
+  }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  explicit operator bool() const { return data != nullptr; }
+  auto view() const { return std::string_view{data, size}; }
+};
+
+#ifdef _WIN32
+inline MappedFile::MappedFile(const std::string& path) {
+  const HANDLE file{CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr)};
+  if (file == INVALID_HANDLE_VALUE)
+    return;
+  if (LARGE_INTEGER sz; GetFileSizeEx(file, &sz) && sz.QuadPart > 0) {
+    if (const HANDLE mapping{CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr)}) {
+      data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+      size = data ? static_cast<size_t>(sz.QuadPart) : 0;
+      CloseHandle(mapping); // the view keeps the mapping alive
+    }
+  }
+  CloseHandle(file);
+}
+
+inline MappedFile::~MappedFile() {
+  if (data)
+    UnmapViewOfFile(data);
+}
+#else
+inline MappedFile::MappedFile(const std::string& path) {
+  const int fd{open(path.c_str(), O_RDONLY)};
+  if (fd < 0)
+    return;
+  if (struct stat st; fstat(fd, &st) == 0 && st.st_size > 0) {
+    if (void* p{mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0)}; p != MAP_FAILED) {
+      data = static_cast<const char*>(p);
+      size = static_cast<size_t>(st.st_size);
+    }
+  }
+  close(fd); // the mapping outlives the descriptor
+}
+
+inline MappedFile::~MappedFile() {
+  if (data)
+    munmap(const_cast<char*>(data), size);
+}
+#endif
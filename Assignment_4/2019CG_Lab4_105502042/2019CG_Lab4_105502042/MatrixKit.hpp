@@ -1,12 +1,25 @@
 #pragma once
 #include <array>
+#include <cmath>
 #include <execution>
 #include <iostream>
+#include <vector>
+#if !defined(NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <immintrin.h>
+#endif
 
-template<size_t N, typename T = double>
+// the scalar of the whole pipeline. define SINGLE_PRECISION to trade double for float,
+// which halves the memory traffic and doubles the SIMD width
+#ifdef SINGLE_PRECISION
+using real = float;
+#else
+using real = double;
+#endif
+
+template<size_t N, typename T = real>
 using Matrix = std::array<std::array<T, N>, N>;
 
-template<size_t N, typename T = double>
+template<size_t N, typename T = real>
 using Vector = std::array<T, N>;
 
 template<size_t N>
@@ -31,7 +44,7 @@ constexpr auto swap(T& a, T& b) {
 }
 
 // transpose a matrix
-template<size_t N, typename T = double>
+template<size_t N, typename T = real>
 constexpr auto transpose(const Matrix<N, T>& a) {
   auto m = a;
   for (size_t i = 0; i < N; ++i)
@@ -40,33 +53,169 @@ constexpr auto transpose(const Matrix<N, T>& a) {
   return m;
 }
 
+// inverse of a nonsingular matrix, Gauss-Jordan elimination with partial pivoting
+template<size_t N, typename T = real>
+inline auto inverse(Matrix<N, T> a) {
+  Matrix<N, T> inv{};
+  for (size_t i = 0; i < N; ++i)
+    inv[i][i] = 1;
+  for (size_t col = 0; col < N; ++col) {
+    size_t pivot{col};
+    for (size_t row = col + 1; row < N; ++row)
+      if (std::abs(a[row][col]) > std::abs(a[pivot][col]))
+        pivot = row;
+    swap(a[col], a[pivot]);
+    swap(inv[col], inv[pivot]);
+    const T p{a[col][col]};
+    for (size_t j = 0; j < N; ++j) {
+      a[col][j] /= p;
+      inv[col][j] /= p;
+    }
+    for (size_t row = 0; row < N; ++row) {
+      if (row == col)
+        continue;
+      const T f{a[row][col]};
+      for (size_t j = 0; j < N; ++j) {
+        a[row][j] -= f * a[col][j];
+        inv[row][j] -= f * inv[col][j];
+      }
+    }
+  }
+  return inv;
+}
+
 // standard inner product
-template<size_t N, typename T = double>
+template<size_t N, typename T = real>
 constexpr auto operator*(const Vector<N, T>& lhs, const Vector<N, T>& rhs) {
-  return std::inner_product(lhs.begin(), lhs.end(), rhs.begin(), 0.0);
+  return std::inner_product(lhs.begin(), lhs.end(), rhs.begin(), T{0});
 }
 
-// matrix multiplication
-template<size_t N, typename T = double>
+// matrix multiplication, sums in the same order as an inner product of a row and a column
+template<size_t N, typename T = real>
 constexpr auto operator*(const Matrix<N, T>& lhs, const Matrix<N, T>& rhs) {
   Matrix<N, T> product{};
-  auto rhst{transpose(rhs)};
-  for (size_t i = 0; i < N; ++i)
-    for (size_t j = 0; j < N; ++j)
-      product[i][j] = lhs[i] * rhst[j];
+  for (size_t i = 0; i < N; ++i) {
+    for (size_t j = 0; j < N; ++j) {
+      auto sum{T{0}};
+      for (size_t k = 0; k < N; ++k)
+        sum = sum + lhs[i][k] * rhs[k][j];
+      product[i][j] = static_cast<T>(sum);
+    }
+  }
   return product;
 }
 
 // matrix X vector ⟼ vector
-template<size_t N, typename T = double>
+template<size_t N, typename T = real>
 constexpr auto operator*(const Matrix<N, T>& lhs, const Vector<N, T>& rhs) {
   Vector<N, T> ret{};
   std::transform(lhs.begin(), lhs.end(), ret.begin(), [&](const auto& l) { return l * rhs; });
   return ret;
 }
 
+// 4-wide kernels for Matrix<4> and Vector<4> of double and float, picked at compile time. define NO_SIMD to fall back
+// to the generic templates above, which keep their exact summation order
+#if !defined(NO_SIMD) && defined(__AVX__)
+#define MATRIXKIT_AVX
+#endif
+#if !defined(NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MATRIXKIT_SSE2
+#endif
+
+#ifdef MATRIXKIT_AVX
+// matrix X vector ⟼ vector, four row products summed horizontally
+inline auto operator*(const Matrix<4, double>& lhs, const Vector<4, double>& rhs) {
+  const __m256d v{_mm256_loadu_pd(rhs.data())};
+  const __m256d s01{_mm256_hadd_pd(_mm256_mul_pd(_mm256_loadu_pd(lhs[0].data()), v), _mm256_mul_pd(_mm256_loadu_pd(lhs[1].data()), v))};
+  const __m256d s23{_mm256_hadd_pd(_mm256_mul_pd(_mm256_loadu_pd(lhs[2].data()), v), _mm256_mul_pd(_mm256_loadu_pd(lhs[3].data()), v))};
+  Vector<4, double> ret;
+  _mm256_storeu_pd(ret.data(), _mm256_add_pd(_mm256_permute2f128_pd(s01, s23, 0x20), _mm256_permute2f128_pd(s01, s23, 0x31)));
+  return ret;
+}
+
+// matrix multiplication, each row of the product is a combination of the rows of rhs so nothing is transposed
+inline auto operator*(const Matrix<4, double>& lhs, const Matrix<4, double>& rhs) {
+  const __m256d r[]{_mm256_loadu_pd(rhs[0].data()), _mm256_loadu_pd(rhs[1].data()), _mm256_loadu_pd(rhs[2].data()), _mm256_loadu_pd(rhs[3].data())};
+  Matrix<4, double> product;
+  for (size_t i = 0; i < 4; ++i) {
+    __m256d row{_mm256_mul_pd(_mm256_set1_pd(lhs[i][0]), r[0])};
+    for (size_t k = 1; k < 4; ++k)
+      row = _mm256_add_pd(row, _mm256_mul_pd(_mm256_set1_pd(lhs[i][k]), r[k]));
+    _mm256_storeu_pd(product[i].data(), row);
+  }
+  return product;
+}
+#elif defined(MATRIXKIT_SSE2)
+// matrix X vector ⟼ vector, two rows per register pair
+inline auto operator*(const Matrix<4, double>& lhs, const Vector<4, double>& rhs) {
+  const __m128d v01{_mm_loadu_pd(rhs.data())}, v23{_mm_loadu_pd(rhs.data() + 2)};
+  const auto half_sums = [&](const Vector<4, double>& row) { // [a0 + a2, a1 + a3]
+    return _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(row.data()), v01), _mm_mul_pd(_mm_loadu_pd(row.data() + 2), v23));
+  };
+  const auto sum_pair = [&](const __m128d a, const __m128d b) { return _mm_add_pd(_mm_unpacklo_pd(a, b), _mm_unpackhi_pd(a, b)); };
+  Vector<4, double> ret;
+  _mm_storeu_pd(ret.data(), sum_pair(half_sums(lhs[0]), half_sums(lhs[1])));
+  _mm_storeu_pd(ret.data() + 2, sum_pair(half_sums(lhs[2]), half_sums(lhs[3])));
+  return ret;
+}
+
+// matrix multiplication, each row of the product is a combination of the rows of rhs so nothing is transposed
+inline auto operator*(const Matrix<4, double>& lhs, const Matrix<4, double>& rhs) {
+  Matrix<4, double> product;
+  for (size_t i = 0; i < 4; ++i) {
+    __m128d lo{_mm_setzero_pd()}, hi{_mm_setzero_pd()};
+    for (size_t k = 0; k < 4; ++k) {
+      const __m128d s{_mm_set1_pd(lhs[i][k])};
+      lo = _mm_add_pd(lo, _mm_mul_pd(s, _mm_loadu_pd(rhs[k].data())));
+      hi = _mm_add_pd(hi, _mm_mul_pd(s, _mm_loadu_pd(rhs[k].data() + 2)));
+    }
+    _mm_storeu_pd(product[i].data(), lo);
+    _mm_storeu_pd(product[i].data() + 2, hi);
+  }
+  return product;
+}
+#endif
+
+#ifdef MATRIXKIT_SSE2
+// matrix X vector ⟼ vector in single precision, the four row products are transposed and summed vertically
+inline auto operator*(const Matrix<4, float>& lhs, const Vector<4, float>& rhs) {
+  const __m128 v{_mm_loadu_ps(rhs.data())};
+  __m128 p0{_mm_mul_ps(_mm_loadu_ps(lhs[0].data()), v)}, p1{_mm_mul_ps(_mm_loadu_ps(lhs[1].data()), v)};
+  __m128 p2{_mm_mul_ps(_mm_loadu_ps(lhs[2].data()), v)}, p3{_mm_mul_ps(_mm_loadu_ps(lhs[3].data()), v)};
+  _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+  Vector<4, float> ret;
+  _mm_storeu_ps(ret.data(), _mm_add_ps(_mm_add_ps(p0, p1), _mm_add_ps(p2, p3)));
+  return ret;
+}
+
+// matrix multiplication in single precision
+inline auto operator*(const Matrix<4, float>& lhs, const Matrix<4, float>& rhs) {
+  const __m128 r[]{_mm_loadu_ps(rhs[0].data()), _mm_loadu_ps(rhs[1].data()), _mm_loadu_ps(rhs[2].data()), _mm_loadu_ps(rhs[3].data())};
+  Matrix<4, float> product;
+  for (size_t i = 0; i < 4; ++i) {
+    __m128 row{_mm_mul_ps(_mm_set1_ps(lhs[i][0]), r[0])};
+    for (size_t k = 1; k < 4; ++k)
+      row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(lhs[i][k]), r[k]));
+    _mm_storeu_ps(product[i].data(), row);
+  }
+  return product;
+}
+#endif
+
+// a + b + c + d summed in the order the Matrix<4> X Vector<4> product of this build sums the four products of a row,
+// so code that transforms vertices without it gets bit-identical results
+constexpr auto sum_like_row(real a, real b, real c, real d) {
+#if defined(MATRIXKIT_SSE2) && (defined(SINGLE_PRECISION) || defined(MATRIXKIT_AVX))
+  return (a + b) + (c + d);
+#elif defined(MATRIXKIT_SSE2)
+  return (a + c) + (b + d);
+#else
+  return (((real{0} + a) + b) + c) + d;
+#endif
+}
+
 // scalar X vector ⟼ vector
-template<typename Scalar, size_t N, typename T = double>
+template<typename Scalar, size_t N, typename T = real>
 constexpr auto operator*(const Scalar lhs, const Vector<N, T>& rhs) {
   Vector<N, T> ret{};
   std::transform(rhs.begin(), rhs.end(), ret.begin(), [&](const auto& r) { return lhs * r; });
@@ -74,7 +223,7 @@ constexpr auto operator*(const Scalar lhs, const Vector<N, T>& rhs) {
 }
 
 // print a vector, has a trailing newline
-template<size_t N, typename T = double>
+template<size_t N, typename T = real>
 constexpr auto operator<<(std::ostream& out, const Vector<N, T>& v) -> std::ostream& {
   for (const auto& a : v)
     out << "[ " << a << " ]" << '\n';
@@ -82,7 +231,7 @@ constexpr auto operator<<(std::ostream& out, const Vector<N, T>& v) -> std::ostr
 }
 
 // print a matrix, has a trailing newline
-template<size_t N, typename T = double>
+template<size_t N, typename T = real>
 constexpr auto operator<<(std::ostream& out, const Matrix<N, T>& m) -> std::ostream& {
   for (const auto& row : m) {
     out << "[ ";
@@ -102,7 +251,7 @@ inline auto operator<<(std::ostream& out, const Polygon_u<N>& vs) -> std::ostrea
 }
 
 // vector - vector ⟼ vector
-template<size_t N, typename T = double>
+template<size_t N, typename T = real>
 constexpr auto operator-(const Vector<N, T>& lhs, const Vector<N, T>& rhs) {
   Vector<N, T> ret{};
   std::transform(lhs.begin(), lhs.end(), rhs.begin(), ret.begin(), [](const auto l, const auto r) { return l - r; });
@@ -110,7 +259,7 @@ constexpr auto operator-(const Vector<N, T>& lhs, const Vector<N, T>& rhs) {
 }
 
 // vector + vector ⟼ vector
-template<size_t N, typename T = double>
+template<size_t N, typename T = real>
 constexpr auto operator+(const Vector<N, T>& lhs, const Vector<N, T>& rhs) {
   Vector<N, T> ret{};
   std::transform(lhs.begin(), lhs.end(), rhs.begin(), ret.begin(), [](const auto l, const auto r) { return l + r; });
@@ -118,7 +267,7 @@ constexpr auto operator+(const Vector<N, T>& lhs, const Vector<N, T>& rhs) {
 }
 
 // return a scaling matrix
-[[nodiscard]] constexpr auto scaling_m(const double sx, const double sy, const double sz = 1.0) {
+[[nodiscard]] constexpr auto scaling_m(const real sx, const real sy, const real sz = 1.0) {
   return Matrix<4>{{{sx, 0, 0, 0},
                     {0, sy, 0, 0},
                     {0, 0, sz, 0},
@@ -126,7 +275,7 @@ constexpr auto operator+(const Vector<N, T>& lhs, const Vector<N, T>& rhs) {
 }
 
 // return a translation matrix
-[[nodiscard]] constexpr auto translation_m(const double dx, const double dy, const double dz = 0.0) {
+[[nodiscard]] constexpr auto translation_m(const real dx, const real dy, const real dz = 0.0) {
   return Matrix<4>{{{1, 0, 0, dx},
                     {0, 1, 0, dy},
                     {0, 0, 1, dz},
@@ -136,8 +285,8 @@ constexpr auto operator+(const Vector<N, T>& lhs, const Vector<N, T>& rhs) {
 // return a rotation matrix
 [[nodiscard]] inline auto rotation_m(double degree, const char axis = 'z') {
   degree *= piDiv180;
-  const double c{cos(degree)};
-  const double s{sin(degree)};
+  const real c{static_cast<real>(cos(degree))};
+  const real s{static_cast<real>(sin(degree))};
   switch (axis) {
   case 'z':
     return Matrix<4>{{{c, -s, 0, 0},
@@ -185,22 +334,76 @@ auto cross_Z = [](const Vector<4>& a, const Vector<4>& b) { return a[0] * b[1] -
 
 template<size_t N>
 auto normalize(const Vector<N>& a) {
-  const double norm = std::sqrt(a * a); // square root of <a, a>
+  const real norm = std::sqrt(a * a); // square root of <a, a>
   Vector<N> b;
   std::transform(a.begin(), a.end(), b.begin(), [&](auto a) { return a / norm; });
   return b;
 }
 
-template<size_t N, typename T = double>
+template<size_t N, typename T = real>
 constexpr auto dot_3D(const Vector<N, T>& lhs, const Vector<N, T>& rhs) {
-  return std::inner_product(lhs.begin(), lhs.begin() + 3, rhs.begin(), 0.0);
+  return std::inner_product(lhs.begin(), lhs.begin() + 3, rhs.begin(), T{0});
 }
 
 auto inline normalize_3D(const Vector<4>& a) {
-  const double norm = {std::sqrt(dot_3D(a, a))}; // square root of <a, a>
+  const real norm = {std::sqrt(dot_3D(a, a))}; // square root of <a, a>
   return Vector<3>{a[0] / norm, a[1] / norm, a[2] / norm};
 }
 
+inline auto get_normal(const Vector<4>& a0, const Vector<4>& a1, const Vector<4>& a2, bool counterclockwise = true) {
+  return counterclockwise ? cross(a1 - a0, a2 - a1) : -1 * cross(a1 - a0, a2 - a1);
+}
+
 inline auto get_normal(const Polygon_u<4>& a, bool counterclockwise = true) {
-  return counterclockwise ? cross(a[1] - a[0], a[2] - a[1]) : -1 * cross(a[1] - a[0], a[2] - a[1]);
+  return get_normal(a[0], a[1], a[2], counterclockwise);
+}
+
+// call f(first, last) on consecutive blocks of [0, n) in parallel
+template<typename F>
+inline void parallel_blocks(size_t n, F f, size_t block = 4096) {
+  std::vector<size_t> firsts((n + block - 1) / block);
+  for (size_t i = 0; i < firsts.size(); ++i)
+    firsts[i] = i * block;
+  std::for_each(std::execution::par, firsts.begin(), firsts.end(), [&](size_t first) { f(first, std::min(first + block, n)); });
+}
+
+// vertices stored as separate x, y, z and w arrays, so every stage that touches all of them is a straight loop over contiguous memory
+struct VertexArrays {
+  std::vector<real> x, y, z, w;
+
+  VertexArrays() = default;
+  explicit VertexArrays(size_t n) : x(n), y(n), z(n), w(n) {}
+
+  auto size() const { return x.size(); }
+  auto resize(size_t n) {
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+    w.resize(n);
+  }
+
+  // gather and scatter one vertex
+  auto operator[](size_t i) const { return Vector<4>{{x[i], y[i], z[i], w[i]}}; }
+  auto set(size_t i, const Vector<4>& v) {
+    x[i] = v[0];
+    y[i] = v[1];
+    z[i] = v[2];
+    w[i] = v[3];
+  }
+};
+
+// matrix X every vertex, one output array at a time, summed like Matrix<4> X Vector<4>
+inline auto operator*(const Matrix<4>& m, const VertexArrays& vs) {
+  VertexArrays ret(vs.size());
+  std::vector<real>* const out[]{&ret.x, &ret.y, &ret.z, &ret.w};
+  parallel_blocks(vs.size(), [&](size_t first, size_t last) {
+    const real *x{vs.x.data()}, *y{vs.y.data()}, *z{vs.z.data()}, *w{vs.w.data()};
+    for (size_t r = 0; r < 4; ++r) {
+      const auto [a, b, c, d] = m[r];
+      real* o{out[r]->data()};
+      for (size_t i = first; i < last; ++i)
+        o[i] = sum_like_row(a * x[i], b * y[i], c * z[i], d * w[i]);
+    }
+  });
+  return ret;
 }
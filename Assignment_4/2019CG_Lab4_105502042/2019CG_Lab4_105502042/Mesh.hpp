@@ -0,0 +1,315 @@
+#pragma once
+#include "MappedFile.hpp"
+#include "MatrixKit.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <type_traits>
+#include <unordered_map>
+
+// a face is `count` consecutive entries of a mesh's index array, starting at `first`
+struct Face {
+  std::uint32_t first, count;
+};
+
+// vertices and faces of an asc file, indices start from 0
+struct Mesh {
+  VertexArrays vertices;
+  std::vector<int> indices;
+  std::vector<Face> faces;
+  std::vector<std::uint32_t> source_faces; // once triangulated, the face of the asc file every triangle was cut from
+  VertexArrays normals;                    // one per vertex, not normalized, w is 0
+};
+
+// area-weighted vertex normals: every face adds its unnormalized normal, twice its area long, to each of its vertices
+inline auto vertex_normals(const Mesh& mesh) {
+  VertexArrays normals(mesh.vertices.size());
+  const auto& vs = mesh.vertices;
+  const auto& is = mesh.indices;
+  for (const auto& f : mesh.faces) {
+    Vector<4> n{};
+    for (std::uint32_t k = 2; k < f.count; ++k)
+      n = n + get_normal(vs[is[f.first]], vs[is[f.first + k - 1]], vs[is[f.first + k]], false);
+    for (std::uint32_t k = 0; k < f.count; ++k)
+      normals.set(is[f.first + k], normals[is[f.first + k]] + n);
+  }
+  return normals;
+}
+
+// axis-aligned bounding box, min exceeds max when it holds nothing
+struct Aabb {
+  Vector<3> min{{std::numeric_limits<real>::infinity(), std::numeric_limits<real>::infinity(), std::numeric_limits<real>::infinity()}};
+  Vector<3> max{{-std::numeric_limits<real>::infinity(), -std::numeric_limits<real>::infinity(), -std::numeric_limits<real>::infinity()}};
+
+  auto empty() const { return min[0] > max[0]; }
+
+  auto corners() const {
+    std::array<Vector<4>, 8> cs;
+    for (size_t i = 0; i < cs.size(); ++i)
+      cs[i] = Vector<4>{{(i & 1 ? max : min)[0], (i & 2 ? max : min)[1], (i & 4 ? max : min)[2], 1}};
+    return cs;
+  }
+};
+
+inline auto bounding_box(const VertexArrays& vs) {
+  Aabb box;
+  const std::vector<real>* const axes[]{&vs.x, &vs.y, &vs.z};
+  for (size_t k = 0; k < 3; ++k)
+    for (const auto a : *axes[k]) {
+      box.min[k] = std::min(box.min[k], a);
+      box.max[k] = std::max(box.max[k], a);
+    }
+  return box;
+}
+
+// reads numbers off a text one line at a time, a number that is missing from its line reads as 0 like a failed stream extraction
+class LineScanner {
+  const char* p;    // read position in the current line
+  const char* eol;  // end of the current line
+  const char* next; // start of the next line
+  const char* end;
+
+public:
+  explicit LineScanner(std::string_view text) : p{text.data()}, eol{p}, next{p}, end{p + text.size()} {}
+
+  // move to the start of the next line, false (and an empty line) at the end of the text
+  auto next_line() {
+    if (next == end) {
+      p = eol = end;
+      return false;
+    }
+    p = next;
+    eol = std::find(p, end, '\n');
+    next = eol == end ? end : eol + 1;
+    return true;
+  }
+
+  auto blank() const { return p == eol; }
+
+  template<typename T>
+  auto number() {
+    while (p != eol && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\v' || *p == '\f'))
+      ++p;
+    if (p != eol && *p == '+')
+      ++p;
+    T value{};
+    if constexpr (std::is_floating_point_v<T>) {
+      // Visual Studio 2017's <charconv> only parses integers, so the number is copied out and parsed by strtod.
+      // a number too long for the buffer reads as 0, like one that is missing
+      char digits[64];
+      const auto last = std::find_if(p, eol, [](char c) { return !std::isdigit(static_cast<unsigned char>(c)) && !std::strchr("+-.eE", c); });
+      if (last == p || static_cast<size_t>(last - p) >= sizeof digits)
+        return value;
+      *std::copy(p, last, digits) = '\0';
+      char* parsed;
+      value = static_cast<T>(std::strtod(digits, &parsed));
+      p += parsed - digits;
+    } else if (const auto [ptr, ec] = std::from_chars(p, eol, value); ec == std::errc{}) {
+      p = ptr;
+    }
+    return value;
+  }
+};
+
+// true if every index names one of vertex_count vertices, checked once at load time so nothing downstream has to
+inline auto indices_in_range(const std::vector<int>& indices, size_t vertex_count) {
+  return std::all_of(indices.begin(), indices.end(), [&](int i) { return i >= 0 && static_cast<size_t>(i) < vertex_count; });
+}
+
+// parse a memory-mapped asc file: "v f", v lines of "x y z", then f lines of "n i1 ... in" with n being 3 or 4,
+// anything after those numbers is ignored and a single blank line may precede the header.
+// nothing if a face names a vertex the file does not have
+inline auto load_asc(const std::string& path) -> std::optional<Mesh> {
+  const MappedFile file{path};
+  if (!file)
+    return std::nullopt;
+
+  LineScanner in{file.view()};
+  if (!in.next_line() || (in.blank() && !in.next_line()))
+    return std::nullopt;
+  const auto v = in.number<size_t>();
+  const auto f = in.number<size_t>();
+
+  Mesh mesh;
+  mesh.vertices.resize(v);
+  for (size_t i = 0; i < v; ++i) {
+    in.next_line();
+    const auto x = in.number<double>();
+    const auto y = in.number<double>();
+    const auto z = in.number<double>();
+    mesh.vertices.set(i, Vector<4>{{static_cast<real>(x), static_cast<real>(y), static_cast<real>(z), 1}});
+  }
+
+  mesh.faces.resize(f);
+  mesh.indices.reserve(f * 4);
+  for (auto& face : mesh.faces) {
+    in.next_line();
+    face = Face{static_cast<std::uint32_t>(mesh.indices.size()), in.number<int>() == 3 ? 3u : 4u};
+    for (std::uint32_t i = 0; i < face.count; ++i)
+      mesh.indices.push_back(in.number<int>() - 1);
+  }
+  if (!indices_in_range(mesh.indices, v))
+    return std::nullopt;
+  return mesh;
+}
+
+// split every face into a fan of triangles
+inline auto triangulate(const Mesh& mesh) {
+  Mesh tris{mesh.vertices, {}, {}, {}, {}};
+  for (const auto& f : mesh.faces) {
+    for (std::uint32_t k = 2; k < f.count; ++k) {
+      tris.faces.push_back(Face{static_cast<std::uint32_t>(tris.indices.size()), 3});
+      tris.source_faces.push_back(static_cast<std::uint32_t>(&f - mesh.faces.data()));
+      tris.indices.insert(tris.indices.end(), {mesh.indices[f.first], mesh.indices[f.first + k - 1], mesh.indices[f.first + k]});
+    }
+  }
+  return tris;
+}
+
+// a binary sidecar (.ascb) starts with this header, followed by vertex_count * 3 floats, triangle_count * 3 uint32_t indices
+// and triangle_count uint32_t source faces, everything in native byte order
+struct AscbHeader {
+  char magic[4];
+  std::uint32_t version;
+  std::uint64_t source_size; // size and modification time of the asc file it was built from
+  std::int64_t source_mtime;
+  std::uint32_t vertex_count;
+  std::uint32_t triangle_count;
+};
+
+constexpr char ascb_magic[4]{'A', 'S', 'C', 'B'};
+constexpr std::uint32_t ascb_version{2};
+
+// map a sidecar, nothing if it is missing, damaged, from another version or built from a different asc file.
+// an index out of range counts as damaged, the asc file is parsed again then
+inline auto load_ascb(const std::string& path, std::uint64_t source_size, std::int64_t source_mtime) -> std::optional<Mesh> {
+  const MappedFile file{path};
+  const auto bytes = file.view();
+  AscbHeader h;
+  if (bytes.size() < sizeof h)
+    return std::nullopt;
+  std::memcpy(&h, bytes.data(), sizeof h);
+  if (std::memcmp(h.magic, ascb_magic, sizeof h.magic) || h.version != ascb_version || h.source_size != source_size || h.source_mtime != source_mtime ||
+      bytes.size() != sizeof h + (size_t{h.vertex_count} * 3 + size_t{h.triangle_count} * 4) * 4)
+    return std::nullopt;
+
+  Mesh mesh;
+  std::vector<float> xyz(size_t{h.vertex_count} * 3);
+  std::memcpy(xyz.data(), bytes.data() + sizeof h, xyz.size() * sizeof(float));
+  mesh.vertices.resize(h.vertex_count);
+  for (size_t i = 0; i < mesh.vertices.size(); ++i)
+    mesh.vertices.set(i, Vector<4>{{xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2], 1}});
+
+  mesh.indices.resize(size_t{h.triangle_count} * 3);
+  std::memcpy(mesh.indices.data(), bytes.data() + sizeof h + xyz.size() * sizeof(float), mesh.indices.size() * sizeof(int));
+  if (!indices_in_range(mesh.indices, h.vertex_count))
+    return std::nullopt;
+  mesh.source_faces.resize(h.triangle_count);
+  std::memcpy(mesh.source_faces.data(), bytes.data() + sizeof h + xyz.size() * sizeof(float) + mesh.indices.size() * sizeof(int),
+              mesh.source_faces.size() * sizeof(std::uint32_t));
+  mesh.faces.resize(h.triangle_count);
+  for (std::uint32_t i = 0; i < h.triangle_count; ++i)
+    mesh.faces[i] = Face{3 * i, 3};
+  return mesh;
+}
+
+// write a triangulated mesh as a sidecar, through a temporary file so concurrent readers never see half of it
+inline auto write_ascb(const std::string& path, const Mesh& mesh, std::uint64_t source_size, std::int64_t source_mtime) {
+  AscbHeader h{};
+  std::memcpy(h.magic, ascb_magic, sizeof h.magic);
+  h.version = ascb_version;
+  h.source_size = source_size;
+  h.source_mtime = source_mtime;
+  h.vertex_count = static_cast<std::uint32_t>(mesh.vertices.size());
+  h.triangle_count = static_cast<std::uint32_t>(mesh.faces.size());
+
+  std::vector<float> xyz;
+  xyz.reserve(mesh.vertices.size() * 3);
+  for (size_t i = 0; i < mesh.vertices.size(); ++i)
+    xyz.insert(xyz.end(), {static_cast<float>(mesh.vertices.x[i]), static_cast<float>(mesh.vertices.y[i]), static_cast<float>(mesh.vertices.z[i])});
+
+  const auto temp_path = path + '.' + std::to_string(std::random_device{}());
+  {
+    std::ofstream out{temp_path, std::ios::binary};
+    out.write(reinterpret_cast<const char*>(&h), sizeof h);
+    out.write(reinterpret_cast<const char*>(xyz.data()), xyz.size() * sizeof(float));
+    out.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(int));
+    out.write(reinterpret_cast<const char*>(mesh.source_faces.data()), mesh.source_faces.size() * sizeof(std::uint32_t));
+    if (out.good()) {
+      out.close();
+      std::error_code ec;
+      std::filesystem::rename(temp_path, path, ec);
+      if (!ec)
+        return true;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::remove(temp_path, ec);
+  return false;
+}
+
+// load an asc file through its sidecar (skull.asc -> skull.ascb), which is rebuilt from the text whenever it is missing or stale.
+// meshes come back triangulated with float precision vertices either way, so the first run renders like every later one.
+// vertex normals are not part of the sidecar, they are summed up here once per mesh
+inline auto load_mesh(const std::string& asc_path) -> std::optional<Mesh> {
+  std::error_code ec;
+  const auto source_size = std::filesystem::file_size(asc_path, ec);
+  if (ec)
+    return std::nullopt;
+  const std::int64_t source_mtime{std::filesystem::last_write_time(asc_path, ec).time_since_epoch().count()};
+  const auto ascb_path = std::filesystem::path{asc_path}.replace_extension(".ascb").string();
+
+  auto mesh = load_ascb(ascb_path, source_size, source_mtime);
+  if (!mesh) {
+    mesh = load_asc(asc_path);
+    if (!mesh)
+      return std::nullopt;
+    mesh = triangulate(*mesh);
+    for (auto* axis : {&mesh->vertices.x, &mesh->vertices.y, &mesh->vertices.z})
+      for (auto& a : *axis)
+        a = static_cast<float>(a);
+    write_ascb(ascb_path, *mesh, source_size, source_mtime); // a read-only directory only costs the next run a parse
+  }
+  mesh->normals = vertex_normals(*mesh);
+  return mesh;
+}
+
+// every asc file is loaded once, the objects made from it share the immutable mesh.
+// safe to share between threads: the first to ask for a path loads it, the others wait for that load instead of repeating it
+class MeshRegistry {
+  using Entry = std::shared_future<std::shared_ptr<const Mesh>>;
+  std::mutex mutex; // guards meshes, not the loads
+  std::unordered_map<std::string, Entry> meshes;
+
+public:
+  // nullptr if path cannot be loaded
+  auto load(const std::string& path) -> std::shared_ptr<const Mesh> {
+    std::promise<std::shared_ptr<const Mesh>> loaded;
+    Entry entry;
+    {
+      const std::lock_guard lock{mutex};
+      const auto [it, first] = meshes.try_emplace(path);
+      if (first)
+        it->second = loaded.get_future().share();
+      else
+        entry = it->second;
+    }
+    if (entry.valid())
+      return entry.get();
+    auto mesh = load_mesh(path);
+    auto shared = mesh ? std::make_shared<const Mesh>(std::move(*mesh)) : nullptr;
+    loaded.set_value(shared);
+    return shared;
+  }
+};
@@ -1,82 +1,73 @@
 #pragma once
 #include "Lighting.hpp"
 #include "MatrixKit.hpp"
-#include <fstream>
-#include <sstream>
+#include "Mesh.hpp"
+#include "Observer.hpp"
+#include "Viewport.hpp"
+#include <array>
+#include <memory>
+#include <optional>
 
-using Face = std::vector<int>;
+// everything a display's result depends on besides the object itself, lighting_version changes with every ambient or light command
+struct DisplayKey {
+  Observer ob_ov;
+  Viewport vp;
+  unsigned lighting_version;
+  bool nobackfaces;
+  bool deferred; // no colors, faces are lit after visibility is known
+  Shading shading;
+};
+
+inline auto operator==(const DisplayKey& a, const DisplayKey& b) {
+  return a.ob_ov == b.ob_ov && a.vp == b.vp && a.lighting_version == b.lighting_version && a.nobackfaces == b.nobackfaces &&
+         a.deferred == b.deferred && a.shading == b.shading;
+}
+
+// displays a scene can have under way at once, each keeps its own cache in every object
+constexpr size_t display_slots{2};
+
+// what the last display computed for an object
+struct DisplayCache {
+  std::optional<DisplayKey> key;
+  std::vector<unsigned char> front; // 1 for every face that faces the eye, empty unless backfaces are culled
+  std::vector<Color> colors;
+  std::vector<Attributes> attributes; // one per vertex, empty for flat shading
+  ScreenPolygons polygons;
+};
 
+// an instance of a shared mesh, placed by its own transformation and lit with its own material
 class Object {
-  size_t v_count;
-  size_t f_count;
-  std::vector<Vector<4>> vertices;
-  std::vector<Face> faces;
-  double Or, Og, Ob, Kd, Ks;
+  std::shared_ptr<const Mesh> mesh;
+  Matrix<4> TM;
+  real Or, Og, Ob, Kd, Ks;
   int N;
+  Aabb bounds; // of the mesh placed in the world
+  mutable std::array<DisplayCache, display_slots> caches;
 
 public:
-  explicit Object(size_t v, size_t f, double Or, double Og, double Ob, double Kd, double Ks, int N)
-      : v_count{v}, f_count{f}, vertices{v}, faces{f}, Or{Or}, Og{Og}, Ob{Ob}, Kd{Kd}, Ks{Ks}, N{N} {}
-
-  auto set_vertex(std::stringstream& ss, std::ifstream& asc_file, const Matrix<4>& TM);
-  auto set_face(std::stringstream& ss, std::ifstream& asc_file);
+  explicit Object(std::shared_ptr<const Mesh> m, const Matrix<4>& TM, real Or, real Og, real Ob, real Kd, real Ks, int N)
+      : mesh{std::move(m)}, TM{TM}, Or{Or}, Og{Og}, Ob{Ob}, Kd{Kd}, Ks{Ks}, N{N}, bounds{bounding_box(get_world_vertices())} {}
 
-  // turn faces into polygons_au
-  auto to_polygons() const;
+  // face f's k-th vertex is get_mesh().vertices[get_indices()[f.first + k]], in model space
+  const auto& get_mesh() const { return *mesh; }
+  const auto& get_indices() const { return mesh->indices; }
+  const auto& get_faces() const { return mesh->faces; }
+  const auto& get_transform() const { return TM; }
+  const auto& get_bounds() const { return bounds; }
 
-  auto get_lighting_info() const { return std::tuple{Or, Og, Ob, Kd, Ks, N}; }
-
-private:
-  auto get_v(const int i) const { return vertices[i - 1]; }
-};
+  // the mesh's vertices placed in the world
+  auto get_world_vertices() const -> VertexArrays { return TM * mesh->vertices; }
 
-inline auto Object::set_vertex(std::stringstream& ss, std::ifstream& asc_file, const Matrix<4>& TM) {
-  std::string line;
-  double a, b, c;
-  auto it = vertices.begin();
-  for (size_t i = 0; i != v_count; ++i, ++it) {
-    while (ss >> line)
-      ;
-    line.clear();
-    ss.clear();
-
-    std::getline(asc_file, line);
-    ss << line;
-    ss >> a >> b >> c;
-    (*it) = TM * Vector<4>{{a, b, c, 1}};
+  // the mesh's vertex normals turned by the inverse transpose of TM, so they stay perpendicular to the faces under any scaling
+  auto get_world_normals() const {
+    auto world = transpose(inverse(TM)) * mesh->normals;
+    std::fill(world.w.begin(), world.w.end(), real{0});
+    return world;
   }
-}
-
-inline auto Object::set_face(std::stringstream& ss, std::ifstream& asc_file) {
-  std::string line;
-  int n, a, b, c, d;
-  auto it = faces.begin();
-  for (size_t i = 0; i != f_count; ++i, ++it) {
-    while (ss >> line)
-      ;
-    line.clear();
-    ss.clear();
 
-    std::getline(asc_file, line);
-    ss << line;
-    ss >> n;
-    if (n == 3) {
-      ss >> a >> b >> c;
-      (*it) = Face{{a, b, c}};
-    } else {
-      ss >> a >> b >> c >> d;
-      (*it) = Face{{a, b, c, d}};
-    }
-  }
-}
+  auto get_lighting_info() const { return std::tuple{Or, Og, Ob, Kd, Ks, N}; }
 
-inline auto Object::to_polygons() const {
-  Polygons_au polygons{f_count};
-  auto it = polygons.begin();
-  for (const auto& face : faces) {
-    for (const auto& i : face)
-      (*it).polygon.emplace_back(get_v(i));
-    ++it;
-  }
-  return polygons;
-}
+  // not part of the object's value, repeated displays with the same key reuse it.
+  // a display only touches the cache of the slot it was given, so two displays can be under way at once
+  auto& get_cache(size_t slot = 0) const { return caches[slot]; }
+};
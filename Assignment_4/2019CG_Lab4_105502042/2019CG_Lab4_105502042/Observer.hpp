@@ -1,11 +1,12 @@
 #pragma once
 #include "MatrixKit.hpp"
+#include <tuple>
 
 struct Observer {
-  double Ex, Ey, Ez, COIx, COIy, COIz, Tilt, Hither, Yon, Hav;
+  real Ex, Ey, Ez, COIx, COIy, COIz, Tilt, Hither, Yon, Hav;
 
   // return projection matrix times eye matrix
-  auto get_pmXem(double AR) const {
+  auto get_pmXem(real AR) const {
     constexpr Vector<4> top_vector{{0, 1, 0, 0}};
     const Vector<4> vz{{COIx - Ex, COIy - Ey, COIz - Ez, 0.0}};
     const Vector<4> v1{cross(top_vector, vz)};
@@ -21,7 +22,7 @@ struct Observer {
                                 {0, 0, 0, 1}}};
 
     // construct PM, projection matrix
-    const auto tan_theta = std::tan(Hav * piDiv180);
+    const auto tan_theta = static_cast<real>(std::tan(Hav * piDiv180));
     const auto a33 = Yon / (Yon - Hither) * tan_theta;
     const Matrix<4> PM{{{1, 0, 0, 0},
                         {0, AR, 0, 0},
@@ -33,3 +34,8 @@ struct Observer {
 
   auto get_eye_pos() const { return Vector<4>{Ex, Ey, Ez, 0.0}; }
 };
+
+inline auto operator==(const Observer& a, const Observer& b) {
+  return std::tie(a.Ex, a.Ey, a.Ez, a.COIx, a.COIy, a.COIz, a.Tilt, a.Hither, a.Yon, a.Hav) ==
+         std::tie(b.Ex, b.Ey, b.Ez, b.COIx, b.COIy, b.COIz, b.Tilt, b.Hither, b.Yon, b.Hav);
+}
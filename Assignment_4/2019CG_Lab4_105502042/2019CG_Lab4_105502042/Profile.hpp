@@ -0,0 +1,121 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#ifdef PROFILE
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+#endif
+
+// built-in instrumentation, compiled in when PROFILE is defined and to nothing otherwise.
+// PROFILE_ZONE("name") times the rest of the enclosing scope, PROFILE_COUNT(counter, n) adds n to a counter of the current display,
+// PROFILE_FRAME() ends a display and PROFILE_ONLY(...) keeps code that only feeds the counters. write_trace saves all of it
+// as Chrome trace events, for chrome://tracing or Perfetto. zones are meant for whole stages, counters may be bumped from any thread
+enum class Counter { polygons_in, polygons_clipped_away, clip_vertices, pixels_tested, depth_passes };
+constexpr std::array<const char*, 5> counter_names{"polygons in", "polygons clipped away", "vertices generated by clipping", "pixels tested",
+                                                   "depth-test passes"};
+
+#ifdef PROFILE
+namespace profile {
+using Clock = std::chrono::steady_clock;
+using Counts = std::array<std::uint64_t, counter_names.size()>;
+
+struct Zone {
+  const char* name;
+  Clock::time_point start;
+  Clock::duration duration;
+  int thread;
+};
+
+struct Frame {
+  Clock::time_point end;
+  Counts counts;
+};
+
+inline const Clock::time_point origin{Clock::now()};
+inline std::mutex mutex; // guards zones and frames
+inline std::vector<Zone> zones;
+inline std::vector<Frame> frames;
+inline std::array<std::atomic<std::uint64_t>, counter_names.size()> counters{};
+inline std::atomic<int> thread_count{0};
+inline thread_local const int thread{thread_count++};
+
+class ScopedZone {
+  const char* name;
+  Clock::time_point start{Clock::now()};
+
+public:
+  explicit ScopedZone(const char* name) : name{name} {}
+  ScopedZone(const ScopedZone&) = delete;
+  ScopedZone& operator=(const ScopedZone&) = delete;
+  ~ScopedZone() {
+    const auto end = Clock::now();
+    const std::lock_guard lock{mutex};
+    zones.push_back(Zone{name, start, end - start, thread});
+  }
+};
+
+inline void count(Counter c, std::uint64_t n) { counters[static_cast<size_t>(c)].fetch_add(n, std::memory_order_relaxed); }
+
+inline void end_frame() {
+  Frame f{Clock::now(), {}};
+  for (size_t i = 0; i < counters.size(); ++i)
+    f.counts[i] = counters[i].exchange(0, std::memory_order_relaxed);
+  const std::lock_guard lock{mutex};
+  frames.push_back(f);
+}
+} // namespace profile
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) const profile::ScopedZone PROFILE_CONCAT(profile_zone_, __LINE__){name}
+#define PROFILE_COUNT(counter, n) profile::count(counter, n)
+#define PROFILE_FRAME() profile::end_frame()
+#define PROFILE_ONLY(...) __VA_ARGS__
+#else
+#define PROFILE_ZONE(name) static_cast<void>(0)
+#define PROFILE_COUNT(counter, n) static_cast<void>(0)
+#define PROFILE_FRAME() static_cast<void>(0)
+#define PROFILE_ONLY(...)
+#endif
+
+constexpr bool profile_enabled{
+#ifdef PROFILE
+    true
+#else
+    false
+#endif
+};
+
+// zones as complete events and the counters of every display as counter events, timestamps in microseconds since the start.
+// false if the file cannot be written or nothing was recorded because PROFILE is not defined
+inline bool write_trace([[maybe_unused]] const std::string& path) {
+#ifdef PROFILE
+  using profile::Clock;
+  const auto us = [](Clock::duration d) { return std::chrono::duration<double, std::micro>{d}.count(); };
+  const std::lock_guard lock{profile::mutex};
+  std::ofstream out{path};
+  out << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  bool first{true};
+  for (const auto& z : profile::zones) {
+    out << (first ? "\n" : ",\n") << "{\"name\": \"" << z.name << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << z.thread
+        << ", \"ts\": " << us(z.start - profile::origin) << ", \"dur\": " << us(z.duration) << '}';
+    first = false;
+  }
+  for (const auto& f : profile::frames) {
+    out << (first ? "\n" : ",\n") << "{\"name\": \"display\", \"ph\": \"C\", \"pid\": 0, \"ts\": " << us(f.end - profile::origin) << ", \"args\": {";
+    for (size_t i = 0; i < f.counts.size(); ++i)
+      out << (i ? ", " : "") << '"' << counter_names[i] << "\": " << f.counts[i];
+    out << "}}";
+    first = false;
+  }
+  out << "\n]}\n";
+  return static_cast<bool>(out);
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,378 @@
+#pragma once
+#include "Framebuffer.hpp"
+#include "Lighting.hpp"
+#include "Profile.hpp"
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <numeric>
+
+// screen coordinates are snapped to fixed point. single precision builds use 16.8 in an int32_t, all a float's 24 bits can hold
+// for windows up to 65536 pixels, double precision builds keep 1/16 pixel
+#ifdef SINGLE_PRECISION
+using subpixel = std::int32_t;
+constexpr int subpixel_bits{8};
+#else
+using subpixel = std::int64_t;
+constexpr int subpixel_bits{4};
+#endif
+constexpr real subpixel_one{1 << subpixel_bits};
+
+// a screen-space triangle set up for half-space rasterization,
+// edge i is E_i(x, y) = A_i * x + B_i * y + C_i at the integer pixel (x, y), the pixel is covered iff all three are >= 0
+struct Triangle {
+  int min_x, min_y, max_x, max_y; // inclusive pixel bounding box
+  std::array<std::int64_t, 3> A, B, C;
+  real z0, dzdx, dzdy;   // depth plane, z(x, y) = z0 + dzdx * x + dzdy * y
+  real min_z;            // nearest depth of the three vertices
+  std::uint32_t payload; // what it writes to the color plane, an RGBA8 color or a face ID
+};
+
+using Triangles = std::pmr::vector<Triangle>;
+
+// edge functions are evaluated in 64 bits whatever the snapped coordinates fit in
+inline auto snap_subpixel(real v) { return static_cast<subpixel>(std::round(v * subpixel_one)); }
+
+// the plane q(x, y) = q0 + dqdx * x + dqdy * y through the values Q at the snapped vertices (X, Y),
+// inv_area is subpixel_one over their signed doubled area
+struct PlaneEquation {
+  real q0, dqdx, dqdy;
+};
+
+inline auto fit_plane(const std::array<std::int64_t, 3>& X, const std::array<std::int64_t, 3>& Y, const std::array<real, 3>& Q, real inv_area) {
+  PlaneEquation p;
+  p.dqdx = ((Q[1] - Q[0]) * (Y[2] - Y[0]) - (Q[2] - Q[0]) * (Y[1] - Y[0])) * inv_area;
+  p.dqdy = ((Q[2] - Q[0]) * (X[1] - X[0]) - (Q[1] - Q[0]) * (X[2] - X[0])) * inv_area;
+  p.q0 = Q[0] - (p.dqdx * X[0] + p.dqdy * Y[0]) / subpixel_one;
+  return p;
+}
+
+// snap three vertices to the subpixel grid and build the edge functions, returns false for degenerate triangles
+inline auto setup_triangle(const Vector<4>& a, const Vector<4>& b, const Vector<4>& c, std::uint32_t payload, Triangle& t) {
+  std::array<std::int64_t, 3> X{snap_subpixel(a[0]), snap_subpixel(b[0]), snap_subpixel(c[0])};
+  std::array<std::int64_t, 3> Y{snap_subpixel(a[1]), snap_subpixel(b[1]), snap_subpixel(c[1])};
+  std::array<real, 3> Z{a[2], b[2], c[2]};
+
+  auto area = (X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]);
+  if (area == 0)
+    return false;
+  if (area < 0) { // make it counterclockwise so the inside is where all edge functions are positive
+    swap(X[1], X[2]);
+    swap(Y[1], Y[2]);
+    swap(Z[1], Z[2]);
+    area = -area;
+  }
+
+  for (size_t i = 0; i < 3; ++i) {
+    const auto j = (i + 1) % 3;
+    const auto dx = X[j] - X[i];
+    const auto dy = Y[j] - Y[i];
+    // top-left fill rule with the framebuffer's row 0 as the top: pixels exactly on a right or top (row 0 facing) edge belong to the neighbor
+    const bool owns_edge{dy < 0 || (dy == 0 && dx > 0)};
+    t.A[i] = -dy * static_cast<std::int64_t>(subpixel_one);
+    t.B[i] = dx * static_cast<std::int64_t>(subpixel_one);
+    t.C[i] = dy * X[i] - dx * Y[i] - (owns_edge ? 0 : 1);
+  }
+
+  // z is linear in screen space after perspective division, so interpolate it with the snapped positions
+  const auto [z0, dzdx, dzdy] = fit_plane(X, Y, Z, subpixel_one / area);
+  t.z0 = z0, t.dzdx = dzdx, t.dzdy = dzdy;
+  t.min_z = std::min({Z[0], Z[1], Z[2]});
+
+  const auto [min_x, max_x] = std::minmax({X[0], X[1], X[2]});
+  const auto [min_y, max_y] = std::minmax({Y[0], Y[1], Y[2]});
+  const auto ceil_px = [](std::int64_t v) { return static_cast<int>((v + (1 << subpixel_bits) - 1) >> subpixel_bits); };
+  const auto floor_px = [](std::int64_t v) { return static_cast<int>(v >> subpixel_bits); };
+  t.min_x = ceil_px(min_x);
+  t.min_y = ceil_px(min_y);
+  t.max_x = floor_px(max_x);
+  t.max_y = floor_px(max_y);
+  t.payload = payload;
+  return true;
+}
+
+// the planes of 1/w (k = 0) and of every attribute divided by w (k = 1...) across a smooth-shaded triangle,
+// dividing the latter by the former at a pixel interpolates the attributes perspective correctly
+struct Varyings {
+  std::array<PlaneEquation, attribute_count + 1> planes;
+};
+
+// screen vertices carry 1/w in their 4th component, their attributes are already divided by w. abc must not be degenerate
+inline auto setup_varyings(const Vector<4>& a, const Vector<4>& b, const Vector<4>& c, const Attributes& aa, const Attributes& ab, const Attributes& ac) {
+  const std::array<std::int64_t, 3> X{snap_subpixel(a[0]), snap_subpixel(b[0]), snap_subpixel(c[0])};
+  const std::array<std::int64_t, 3> Y{snap_subpixel(a[1]), snap_subpixel(b[1]), snap_subpixel(c[1])};
+  const real inv_area{subpixel_one / ((X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]))};
+
+  Varyings v;
+  v.planes[0] = fit_plane(X, Y, {a[3], b[3], c[3]}, inv_area);
+  for (size_t k = 0; k < attribute_count; ++k)
+    v.planes[k + 1] = fit_plane(X, Y, {aa[k], ab[k], ac[k]}, inv_area);
+  return v;
+}
+
+// the attributes at the integer pixel (x, y)
+inline auto interpolate(const Varyings& v, int x, int y) {
+  const auto at = [&](const PlaneEquation& p) { return p.q0 + p.dqdx * x + p.dqdy * y; };
+  const real w{1 / at(v.planes[0])};
+  Attributes a;
+  for (size_t k = 0; k < attribute_count; ++k)
+    a[k] = at(v.planes[k + 1]) * w;
+  return a;
+}
+
+// polygons are handed to the rasterizer as a list of batches, e.g. one per object, so nothing has to be concatenated
+using PolygonBatches = std::pmr::vector<const ScreenPolygons*>;
+
+// the triangles [first, last) that came from one batch, with the pixel bounding box and nearest depth of all of them
+struct TriangleBatch {
+  std::uint32_t first, last;
+  int min_x, min_y, max_x, max_y;
+  real min_z;
+};
+
+struct TriangleSetup {
+  Triangles triangles;
+  std::pmr::vector<TriangleBatch> batches;
+  std::pmr::vector<Varyings> varyings; // one per triangle if the polygons carry attributes, empty otherwise
+};
+
+// split every convex polygon into a triangle fan around its first vertex, degenerate triangles get an empty bounding box.
+// payload(b, ps, p) gives what the triangles of polygon p in batch b (ps) write to the color plane unless they are smooth shaded.
+// the result and its scratch come from memory
+template<typename Payload>
+inline auto setup_triangles(const PolygonBatches& batches, Payload payload, std::pmr::memory_resource* memory = std::pmr::get_default_resource()) {
+  std::pmr::vector<size_t> first{memory}; // the i-th polygon over all batches owns the triangles [first[i], first[i + 1])
+  size_t polygon_count{0};
+  for (const auto ps : batches)
+    polygon_count += ps->size();
+  first.reserve(polygon_count + 1);
+  first.push_back(0);
+  bool smooth{false};
+  for (const auto ps : batches) {
+    for (size_t p = 0; p < ps->size(); ++p) {
+      const auto n = ps->offsets[p + 1] - ps->offsets[p];
+      first.push_back(first.back() + (n < 3 ? 0 : n - 2));
+    }
+    smooth |= !ps->attributes.empty();
+  }
+
+  TriangleSetup setup{Triangles(first.back(), memory), std::pmr::vector<TriangleBatch>{memory}, std::pmr::vector<Varyings>(smooth ? first.back() : 0, memory)};
+  setup.batches.reserve(batches.size());
+  auto& ts = setup.triangles;
+  auto batch_first = first.begin();
+  for (const auto ps : batches) {
+    const auto batch = setup.batches.size();
+    const auto& vs = ps->vertices;
+    const auto& as = ps->attributes;
+    parallel_blocks(ps->size(), [&](size_t first_polygon, size_t last_polygon) {
+      for (auto p = first_polygon; p < last_polygon; ++p) {
+        const std::uint32_t value{as.empty() ? payload(batch, *ps, static_cast<std::uint32_t>(p)) : 0};
+        const auto is = ps->indices.begin() + ps->offsets[p];
+        const auto n = ps->offsets[p + 1] - ps->offsets[p];
+        const auto v0 = vs[is[0]];
+        auto t = batch_first[p];
+        for (size_t i = 2; i < n; ++i, ++t)
+          if (!setup_triangle(v0, vs[is[i - 1]], vs[is[i]], value, ts[t]))
+            ts[t].min_x = 0, ts[t].max_x = -1;
+          else if (!as.empty())
+            setup.varyings[t] = setup_varyings(v0, vs[is[i - 1]], vs[is[i]], as[is[0]], as[is[i - 1]], as[is[i]]);
+      }
+    }, 1024);
+
+    TriangleBatch b{static_cast<std::uint32_t>(batch_first[0]), static_cast<std::uint32_t>(batch_first[ps->size()]), std::numeric_limits<int>::max(),
+                    std::numeric_limits<int>::max(), std::numeric_limits<int>::min(), std::numeric_limits<int>::min(), std::numeric_limits<real>::infinity()};
+    for (auto t = ts.begin() + b.first; t != ts.begin() + b.last; ++t) {
+      if (t->min_x > t->max_x || t->min_y > t->max_y)
+        continue;
+      b.min_x = std::min(b.min_x, t->min_x), b.max_x = std::max(b.max_x, t->max_x);
+      b.min_y = std::min(b.min_y, t->min_y), b.max_y = std::max(b.max_y, t->max_y);
+      b.min_z = std::min(b.min_z, t->min_z);
+    }
+    setup.batches.push_back(b);
+    batch_first += ps->size();
+  }
+  return setup;
+}
+
+constexpr int tile_size{32}; // tiles are 32x32 pixels
+constexpr int hiz_block{8};  // the depth pyramid keeps the farthest depth of every 8x8 block of a tile and of the whole tile
+constexpr int blocks_per_tile{tile_size / hiz_block};
+
+// the coarse levels of a tile's depth pyramid, nothing whose nearest depth is at or behind them can pass the depth test.
+// only the thread rasterizing the tile touches it
+template<typename Depth>
+struct TileDepth {
+  Depth tile_max;
+  std::array<Depth, blocks_per_tile * blocks_per_tile> block_max;
+
+  // everything within the framebuffer starts out as far as possible, blocks beyond its edge never hold the maximum
+  TileDepth(int x0, int y0, int x1, int y1) : tile_max{DepthTraits<Depth>::far} {
+    for (int by = 0; by < blocks_per_tile; ++by)
+      for (int bx = 0; bx < blocks_per_tile; ++bx)
+        block_max[by * blocks_per_tile + bx] =
+            x0 + bx * hiz_block < x1 && y0 + by * hiz_block < y1 ? DepthTraits<Depth>::far : std::numeric_limits<Depth>::lowest();
+  }
+
+  auto occludes(real min_z) const { return DepthTraits<Depth>::encode(min_z) >= tile_max; }
+};
+
+// rasterize a triangle into the pixels [min_x, max_x] x [min_y, max_y] of the framebuffer, value(x, y) is what a pixel that passes
+// the depth test gets. returns the farthest depth it overwrote, the lowest depth value if it wrote nothing
+template<typename Depth, typename Value>
+inline auto rasterize_rect(const Triangle& t, Framebuffer<Depth>& fb, int min_x, int min_y, int max_x, int max_y, Value value) {
+  const auto [A0, A1, A2] = t.A;
+  std::int64_t r0{t.A[0] * min_x + t.B[0] * min_y + t.C[0]};
+  std::int64_t r1{t.A[1] * min_x + t.B[1] * min_y + t.C[1]};
+  std::int64_t r2{t.A[2] * min_x + t.B[2] * min_y + t.C[2]};
+  real zr{t.z0 + t.dzdx * min_x + t.dzdy * min_y};
+  auto overwritten = std::numeric_limits<Depth>::lowest();
+  PROFILE_ONLY(std::uint64_t tested{0}, passed{0};)
+
+  for (int y = min_y; y <= max_y; ++y, r0 += t.B[0], r1 += t.B[1], r2 += t.B[2], zr += t.dzdy) {
+    auto zrow = fb.depth_row(y);
+    auto crow = fb.color_row(y);
+    auto e0{r0}, e1{r1}, e2{r2};
+    auto z{zr};
+    for (int x = min_x; x <= max_x; ++x, e0 += A0, e1 += A1, e2 += A2, z += t.dzdx) {
+      if ((e0 | e1 | e2) >= 0) {
+        PROFILE_ONLY(++tested;)
+        if (const auto depth = DepthTraits<Depth>::encode(z); depth < zrow[x]) {
+          PROFILE_ONLY(++passed;)
+          overwritten = std::max(overwritten, zrow[x]);
+          zrow[x] = depth;
+          crow[x] = value(x, y);
+        }
+      }
+    }
+  }
+  PROFILE_COUNT(Counter::pixels_tested, tested);
+  PROFILE_COUNT(Counter::depth_passes, passed);
+  return overwritten;
+}
+
+// rasterize a triangle into the tile [x0, x1) x [y0, y1), skipping the 8x8 blocks whose farthest depth it cannot beat.
+// writes only ever bring depths nearer, so a block's farthest depth has to be found again only when a pixel holding it is overwritten
+template<typename Depth, typename Value>
+inline void rasterize(const Triangle& t, Framebuffer<Depth>& fb, TileDepth<Depth>& hiz, int x0, int y0, int x1, int y1, Value value) {
+  const int min_x{std::max(t.min_x, x0)}, max_x{std::min(t.max_x, x1 - 1)};
+  const int min_y{std::max(t.min_y, y0)}, max_y{std::min(t.max_y, y1 - 1)};
+  if (min_x > max_x || min_y > max_y)
+    return;
+
+  const int bx_min{(min_x - x0) / hiz_block}, bx_max{(max_x - x0) / hiz_block};
+  const int by_min{(min_y - y0) / hiz_block}, by_max{(max_y - y0) / hiz_block};
+  const auto block_max = [&](int bx, int by) -> auto& { return hiz.block_max[by * blocks_per_tile + bx]; };
+  const auto near = DepthTraits<Depth>::encode(t.min_z);
+  int passed{0};
+  for (int by = by_min; by <= by_max; ++by)
+    for (int bx = bx_min; bx <= bx_max; ++bx)
+      passed += near < block_max(bx, by);
+  if (!passed)
+    return;
+
+  auto overwritten = std::numeric_limits<Depth>::lowest();
+  if (passed == (bx_max - bx_min + 1) * (by_max - by_min + 1)) { // nothing to skip, walk the bounding box in one go
+    overwritten = rasterize_rect(t, fb, min_x, min_y, max_x, max_y, value);
+  } else {
+    for (int by = by_min; by <= by_max; ++by)
+      for (int bx = bx_min; bx <= bx_max; ++bx)
+        if (near < block_max(bx, by))
+          overwritten = std::max(overwritten, rasterize_rect(t, fb, std::max(min_x, x0 + bx * hiz_block), std::max(min_y, y0 + by * hiz_block),
+                                                             std::min(max_x, x0 + bx * hiz_block + hiz_block - 1),
+                                                             std::min(max_y, y0 + by * hiz_block + hiz_block - 1), value));
+  }
+
+  bool refreshed{false};
+  for (int by = by_min; by <= by_max; ++by) {
+    for (int bx = bx_min; bx <= bx_max; ++bx) {
+      if (overwritten < block_max(bx, by))
+        continue;
+      const int bx0{x0 + bx * hiz_block}, bx1{std::min(bx0 + hiz_block, x1)};
+      const int by0{y0 + by * hiz_block}, by1{std::min(by0 + hiz_block, y1)};
+      auto m = std::numeric_limits<Depth>::lowest();
+      for (int y = by0; y < by1 && m < block_max(bx, by); ++y) { // nothing can exceed the old maximum, stop once it is found again
+        const auto zrow = fb.depth_row(y);
+        for (int x = bx0; x < bx1; ++x)
+          m = std::max(m, zrow[x]);
+      }
+      refreshed |= m != block_max(bx, by);
+      block_max(bx, by) = m;
+    }
+  }
+  if (refreshed)
+    hiz.tile_max = *std::max_element(hiz.block_max.begin(), hiz.block_max.end());
+}
+
+// the triangles overlapping each tile, kept in submission order so depth ties resolve like a serial pass
+struct TileBins {
+  int tiles_x, tiles_y;
+  std::pmr::vector<std::pmr::vector<std::uint32_t>> bins;
+};
+
+// the bins and everything in them come from memory, every bin is counted first so it is allocated exactly once
+inline auto bin_triangles(const Triangles& ts, int width, int height, std::pmr::memory_resource* memory = std::pmr::get_default_resource()) {
+  TileBins tb{(width + tile_size - 1) / tile_size, (height + tile_size - 1) / tile_size, std::pmr::vector<std::pmr::vector<std::uint32_t>>{memory}};
+  tb.bins.resize(static_cast<size_t>(tb.tiles_x) * tb.tiles_y);
+
+  const auto for_each_tile = [&](auto f) {
+    for (std::uint32_t i = 0; i < ts.size(); ++i) {
+      const auto& t = ts[i];
+      const int min_x{std::max(t.min_x, 0)}, max_x{std::min(t.max_x, width - 1)};
+      const int min_y{std::max(t.min_y, 0)}, max_y{std::min(t.max_y, height - 1)};
+      if (min_x > max_x || min_y > max_y)
+        continue;
+      for (int ty = min_y / tile_size; ty <= max_y / tile_size; ++ty)
+        for (int tx = min_x / tile_size; tx <= max_x / tile_size; ++tx)
+          f(tb.bins[static_cast<size_t>(ty) * tb.tiles_x + tx], i);
+    }
+  };
+  std::pmr::vector<std::uint32_t> counts(tb.bins.size(), memory);
+  for_each_tile([&](const auto& bin, std::uint32_t) { ++counts[&bin - tb.bins.data()]; });
+  for (size_t b = 0; b < tb.bins.size(); ++b)
+    tb.bins[b].reserve(counts[b]);
+  for_each_tile([](auto& bin, std::uint32_t i) { bin.push_back(i); });
+  return tb;
+}
+
+// rasterize_rect bumps atomic counters in PROFILE builds, and calls that synchronize are not allowed under par_unseq
+#ifdef PROFILE
+constexpr const auto& tile_policy = std::execution::par;
+#else
+constexpr const auto& tile_policy = std::execution::par_unseq;
+#endif
+
+// every tile is rasterized by one thread, tiles never share pixels so the depth buffer needs no locks.
+// a batch (usually an object) or a triangle whose nearest depth lies behind everything already in the tile is skipped whole,
+// which works best when the batches come front to back. a visible pixel of a smooth-shaded triangle of batch b gets
+// shade(b, attributes) with the attributes interpolated there, any other pixel its triangle's payload
+template<typename Depth, typename Shade>
+inline void rasterize_tiles(const TriangleSetup& setup, const TileBins& tb, Framebuffer<Depth>& fb, Shade shade) {
+  const auto& ts = setup.triangles;
+  const auto& batches = setup.batches;
+  std::for_each(tile_policy, tb.bins.begin(), tb.bins.end(), [&](const auto& bin) {
+    const auto tile = static_cast<int>(&bin - tb.bins.data());
+    const int x0{tile % tb.tiles_x * tile_size}, y0{tile / tb.tiles_x * tile_size};
+    const int x1{std::min(x0 + tile_size, fb.get_width())}, y1{std::min(y0 + tile_size, fb.get_height())};
+    TileDepth<Depth> hiz{x0, y0, x1, y1};
+
+    auto batch = batches.begin();
+    for (auto i = bin.begin(); i != bin.end();) {
+      if (*i >= batch->last) { // entering the next batch that has triangles here
+        batch = std::upper_bound(batch, batches.end(), *i, [](std::uint32_t i, const TriangleBatch& b) { return i < b.last; });
+        if (hiz.occludes(batch->min_z)) {
+          i = std::lower_bound(i, bin.end(), batch->last);
+          continue;
+        }
+      }
+      if (const auto& t = ts[*i]; !hiz.occludes(t.min_z)) {
+        if (setup.varyings.empty()) {
+          rasterize(t, fb, hiz, x0, y0, x1, y1, [&](int, int) { return t.payload; });
+        } else {
+          const auto b = static_cast<size_t>(batch - batches.begin());
+          rasterize(t, fb, hiz, x0, y0, x1, y1, [&, &v = setup.varyings[*i]](int x, int y) { return shade(b, interpolate(v, x, y)); });
+        }
+      }
+      ++i;
+    }
+  });
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "Scene.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// a fixed number of threads that run jobs in the order they were submitted. the destructor finishes every job first
+class ThreadPool {
+  std::mutex mutex; // guards jobs and stopping
+  std::condition_variable ready;
+  std::deque<std::function<void()>> jobs;
+  bool stopping{false};
+  std::vector<std::thread> threads;
+
+  void work() {
+    for (;;) {
+      std::unique_lock lock{mutex};
+      ready.wait(lock, [&] { return stopping || !jobs.empty(); });
+      if (jobs.empty())
+        return;
+      auto job = std::move(jobs.front());
+      jobs.pop_front();
+      lock.unlock();
+      job();
+    }
+  }
+
+public:
+  explicit ThreadPool(unsigned count) {
+    threads.reserve(std::max(count, 1u));
+    for (unsigned i = 0; i < std::max(count, 1u); ++i)
+      threads.emplace_back([this] { work(); });
+  }
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ~ThreadPool() {
+    {
+      const std::lock_guard lock{mutex};
+      stopping = true;
+    }
+    ready.notify_all();
+    for (auto& t : threads)
+      t.join();
+  }
+
+  auto size() const { return threads.size(); }
+
+  // what job returns, or throws, once a thread has run it
+  template<typename F>
+  auto submit(F job) -> std::future<std::invoke_result_t<F>> {
+    auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::move(job)); // std::function needs a copyable job
+    auto result = task->get_future();
+    {
+      const std::lock_guard lock{mutex};
+      jobs.emplace_back([task] { (*task)(); });
+    }
+    ready.notify_one();
+    return result;
+  }
+};
+
+// runs many scripts at once, each as its own scene on a thread of the pool. the scenes load every mesh once between them,
+// and what they report is written to out a whole line at a time, so the lines of different scenes never mix
+class Renderer {
+  MeshRegistry meshes;
+  std::mutex out_mutex;
+  std::ostream& out;
+  ThreadPool pool; // last, so the threads are done before anything they use goes away
+
+public:
+  explicit Renderer(std::ostream& out, unsigned threads = std::thread::hardware_concurrency()) : out{out}, pool{threads} {}
+
+  auto& get_meshes() { return meshes; }
+
+  auto report() -> Report {
+    return [this](const std::string& line) {
+      const std::lock_guard lock{out_mutex};
+      out << line << std::flush;
+    };
+  }
+
+  // render the script at path, display n to out_prefix<n>.ppm. the future is false if the script cannot be read
+  // or a display cannot be written
+  auto submit(std::string path, std::string out_prefix) -> std::future<bool> {
+    return pool.submit([this, path = std::move(path), out_prefix = std::move(out_prefix)] {
+      std::ifstream script{path};
+      const auto size = read_window_size(script);
+      if (!size) {
+        report()("cannot read " + path + '\n');
+        return false;
+      }
+      Scene scene{size->first, size->second, meshes, ppm_files(out_prefix, report()), report(), std::filesystem::path{path}.parent_path()};
+      return scene.run(script);
+    });
+  }
+};
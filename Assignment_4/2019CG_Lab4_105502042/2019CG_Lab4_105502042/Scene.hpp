@@ -0,0 +1,429 @@
+#pragma once
+#include "BoundedQueue.hpp"
+#include "DrawKit.hpp"
+#include "FrameArena.hpp"
+#include "Profile.hpp"
+#include "Stages.hpp"
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <istream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+
+// some hash function found on the Internet. I need a constexpr hash function.
+constexpr size_t fnv1a_32(char const* s, std::size_t count) {
+#ifdef _MSC_VER
+#pragma warning(disable : 4307)
+#endif
+  return ((count ? fnv1a_32(s, count - 1) : 2166136261U) ^ s[count]) * 16777619U;
+}
+constexpr size_t operator""_hash(char const* s, const size_t count) { return fnv1a_32(s, count); }
+
+// what a scene does with a display once it is rendered, false if the display could not be written out,
+// and what it does with the lines it has to say
+using FrameSink = std::function<bool(const Framebuffer<>& fb, const Viewport& vp)>;
+using Report = std::function<void(const std::string& line)>;
+
+// display n goes to out_prefix<n>.ppm
+inline auto ppm_files(std::string out_prefix, Report report) -> FrameSink {
+  return [out_prefix = std::move(out_prefix), report = std::move(report), n = 0](const Framebuffer<>& fb, const Viewport& vp) mutable {
+    const auto path = out_prefix + std::to_string(n++) + ".ppm";
+    if (write_ppm(fb, vp, path))
+      return true;
+    report("cannot write " + path + '\n');
+    return false;
+  };
+}
+
+// every display goes to out as soon as it is rendered, one PPM after another
+inline auto ppm_stream(std::ostream& out) -> FrameSink {
+  return [&out](const Framebuffer<>& fb, const Viewport& vp) { return write_ppm(fb, vp, out) && out.flush(); };
+}
+
+// the first line of a script, the size of the window. nothing if it is missing or not positive
+inline auto read_window_size(std::istream& script) -> std::optional<std::pair<int, int>> {
+  std::string line;
+  int w{0}, h{0};
+  if (!std::getline(script, line) || !(std::istringstream{line} >> w >> h) || w <= 0 || h <= 0)
+    return std::nullopt;
+  return std::pair{w, h};
+}
+
+// the state a script builds up, fed one line at a time. scenes only share the mesh registry, so different scenes can run
+// on different threads at once, while each scene belongs to one thread at a time.
+// a pipelined scene splits every display in two: its geometry (culling, shading, projection) runs on the thread that feeds
+// the script, then its raster stage (depth test, deferred or phong lighting, on_frame) runs on a thread of the scene's own,
+// while the geometry of the next display is already under way. the two stages hand each other display slots through
+// bounded queues, each slot has its own framebuffer, arena and object caches, so at most display_slots displays are in
+// flight. on_frame and report are then called from the raster thread, one display after another in script order, and the
+// PROFILE counters of a display may include some of the next one's geometry
+class Scene {
+  // a display between its two stages, with copies of whatever the script may change before it is rasterized
+  struct PendingDisplay {
+    size_t slot;
+    std::chrono::high_resolution_clock::time_point t0;
+    DisplayKey key;
+    std::vector<std::uint32_t> visible;
+    PolygonBatches ps_screen; // from the slot's arena
+    Background background;
+    Ambient ambient;
+    std::vector<Light> lights;
+  };
+
+  struct Slot {
+    Framebuffer<> fb;
+    FrameArena arena; // everything a display allocates only for itself, rewound when its slot is freed
+  };
+
+  int win_x, win_y;
+  MeshRegistry& meshes;
+  FrameSink on_frame;
+  Report report;
+  std::filesystem::path script_dir; // meshes are looked for next to the script too
+
+  Matrix<4> TM{identity_matrix};
+  Viewport vp;
+  Observer ob_ov;
+  std::vector<Object> objects;
+  Bvh bvh; // over the objects' bounds, rebuilt when objects have been added since
+  Background background;
+  Ambient ambient;
+  std::vector<Light> lights;
+  unsigned lighting_version{0};
+  bool nobackfaces{false};
+  bool fronttoback{false}; // draw objects nearest first so more of the farther ones are rejected by the depth pyramid
+  bool deferred{false};    // find the visible faces first and light only those, flat shading only
+  Shading shading{Shading::flat};
+  bool ended{false};
+  bool frame_lost{false}; // on_frame failed, written by the raster stage and read once every display is out
+
+  mutable std::mutex report_mutex; // both stages report
+  std::array<Slot, display_slots> slots;
+  BoundedQueue<size_t> free_slots{display_slots};
+  BoundedQueue<std::optional<PendingDisplay>> pending{display_slots}; // nothing stops the raster thread
+  std::thread raster_thread;                                           // only if pipelined
+
+  void say(const std::string& line) const {
+    const std::lock_guard lock{report_mutex};
+    report(line);
+  }
+
+  // from the geometry stage, after the displays before it have said theirs
+  void say_in_order(const std::string& line) {
+    drain();
+    say(line);
+  }
+
+  void update_bvh() {
+    if (bvh.size() != objects.size()) {
+      std::vector<Aabb> bounds(objects.size());
+      std::transform(objects.begin(), objects.end(), bounds.begin(), [](const Object& obj) { return obj.get_bounds(); });
+      bvh = Bvh{std::move(bounds)};
+    }
+  }
+
+  static auto process_background(std::istream& ss) {
+    real Br, Bg, Bb;
+    ss >> Br >> Bg >> Bb;
+    return Background{Br, Bg, Bb};
+  }
+
+  static auto process_ambient(std::istream& ss) {
+    real KaIar, KaIag, KaIab;
+    ss >> KaIar >> KaIag >> KaIab;
+    return Ambient{KaIar, KaIag, KaIab};
+  }
+
+  void process_light(std::istream& ss) {
+    size_t index;
+    real Ipr, Ipg, Ipb, Ix, Iy, Iz;
+    ss >> index >> Ipr >> Ipg >> Ipb >> Ix >> Iy >> Iz;
+    if (index > lights.size())
+      lights.push_back(Light{Ipr, Ipg, Ipb, Ix, Iy, Iz});
+    else
+      lights[index - 1] = Light{Ipr, Ipg, Ipb, Ix, Iy, Iz};
+  }
+
+  static auto process_scale(std::istream& ss) {
+    real x, y, z;
+    ss >> x >> y >> z;
+    return scaling_m(x, y, z);
+  }
+
+  static auto process_rotate(std::istream& ss) {
+    real x, y, z;
+    ss >> x >> y >> z;
+    if (x)
+      return rotation_m(x, 'x');
+    else if (y)
+      return rotation_m(y, 'y');
+    else
+      return rotation_m(z);
+  }
+
+  static auto process_translate(std::istream& ss) {
+    real x, y, z;
+    ss >> x >> y >> z;
+    return translation_m(x, y, z);
+  }
+
+  auto process_viewport(std::istream& ss) const {
+    real vxl, vxr, vyb, vyt;
+    ss >> vxl >> vxr >> vyb >> vyt;
+    return Viewport{(vxr - vxl) / (vyt - vyb), vxl, vxr, vyb, vyt, win_x, win_y};
+  }
+
+  auto process_object(std::istream& ss) {
+    const StageTimer timer{Stage::load};
+    std::string asc_path;
+    real Or, Og, Ob, Kd, Ks;
+    int N;
+    ss >> asc_path >> Or >> Og >> Ob >> Kd >> Ks >> N;
+
+    auto mesh = meshes.load(asc_path);
+    if (!mesh && !script_dir.empty())
+      mesh = meshes.load((script_dir / asc_path).string());
+    if (!mesh)
+      mesh = meshes.load("../Debug/" + asc_path);
+    if (!mesh) {
+      say_in_order("cannot read " + asc_path + '\n');
+      mesh = std::make_shared<const Mesh>();
+    }
+
+    return Object{std::move(mesh), TM, Or, Og, Ob, Kd, Ks, N};
+  }
+
+  auto process_shading(std::istream& ss) {
+    std::string mode;
+    ss >> mode;
+    if (mode == "gouraud")
+      return Shading::gouraud;
+    if (mode == "phong")
+      return Shading::phong;
+    if (mode != "flat")
+      say_in_order("unknown shading " + mode + ", using flat\n");
+    return Shading::flat;
+  }
+
+  static auto process_observer(std::istream& ss) {
+    real Ex, Ey, Ez, COIx, COIy, COIz, Tilt, Hither, Yon, Hav;
+    ss >> Ex >> Ey >> Ez >> COIx >> COIy >> COIz >> Tilt >> Hither >> Yon >> Hav;
+    return Observer{Ex, Ey, Ez, COIx, COIy, COIz, Tilt, Hither, Yon, Hav};
+  }
+
+  void process_pick(std::istream& ss) {
+    int x, y;
+    ss >> x >> y;
+    update_bvh();
+    auto line = "pick " + std::to_string(x) + ' ' + std::to_string(y) + ": ";
+    if (const auto p = pick(bvh, objects, x, y, ob_ov, vp, nobackfaces))
+      line += "object " + std::to_string(p->object + 1) + " face " + std::to_string(p->face + 1) + '\n';
+    else
+      line += "background\n";
+    say_in_order(line);
+  }
+
+  // the geometry stage, waits for a free slot first
+  void process_display() {
+    const auto slot = free_slots.pop();
+    const auto t0 = std::chrono::high_resolution_clock::now();
+    auto& arena = slots[slot].arena;
+    PROFILE_ZONE("geometry");
+    update_bvh();
+
+    // objects outside the frustum are skipped whole,
+    // objects that were already displayed under the same key are not shaded or projected again.
+    // deferred and phong polygons carry no colors, so lighting changes do not invalidate them
+    const bool lit_later{shading == Shading::phong || (deferred && shading == Shading::flat)};
+    const DisplayKey key{ob_ov, vp, lit_later ? 0 : lighting_version, nobackfaces, deferred && shading == Shading::flat, shading};
+    auto visible = visible_objects(bvh, ob_ov.get_pmXem(vp.AR));
+    if (fronttoback)
+      sort_front_to_back(visible, objects, ob_ov);
+    PolygonBatches ps_screen{&arena};
+    ps_screen.reserve(visible.size());
+    for (const auto i : visible)
+      ps_screen.push_back(&screen_polygons(objects[i], key, ambient, lights, &arena, slot));
+
+    std::optional<PendingDisplay> d{PendingDisplay{slot, t0, key, std::move(visible), std::move(ps_screen), background, ambient, lights}};
+    if (raster_thread.joinable()) {
+      pending.push(std::move(d));
+      return;
+    }
+    rasterize(*d);
+    d.reset();
+    release(slot);
+  }
+
+  // the raster stage, reads nothing of the scene but objects, which do not change while displays are in flight
+  void rasterize(const PendingDisplay& d) {
+    PROFILE_ZONE("raster");
+    auto& fb = slots[d.slot].fb;
+    auto& arena = slots[d.slot].arena;
+    const auto& key = d.key;
+    const auto& visible = d.visible;
+    const auto background_rgba = pack_rgba(Color{d.background.Br, d.background.Bg, d.background.Bb});
+    StageTimer timer{Stage::rasterize};
+    if (key.deferred) {
+      std::vector<std::uint32_t> first_id{0};
+      for (const auto i : visible)
+        first_id.push_back(first_id.back() + static_cast<std::uint32_t>(objects[i].get_faces().size()));
+      fb.clear(0);
+      z_buffer_algorithm(d.ps_screen, fb, &arena, [&](size_t b, const ScreenPolygons& ps, std::uint32_t p) { return first_id[b] + ps.faces[p] + 1; });
+      timer.next(Stage::shade);
+      deferred_shading(fb, objects, visible, first_id, key.ob_ov, d.ambient, d.lights, background_rgba, &arena);
+    } else if (key.shading == Shading::phong) { // pixels are lit while they are rasterized, all of it counts as rasterize
+      const auto eye = key.ob_ov.get_eye_pos();
+      fb.clear(background_rgba);
+      z_buffer_algorithm(
+          d.ps_screen, fb, &arena, [](size_t, const ScreenPolygons& ps, std::uint32_t p) { return pack_rgba(ps.colors[p]); },
+          [&](size_t b, const Attributes& a) { return pack_rgba(shade_pixel(objects[visible[b]], a, eye, d.ambient, d.lights)); });
+    } else {
+      fb.clear(background_rgba);
+      z_buffer_algorithm(d.ps_screen, fb, &arena);
+    }
+
+    timer.stop();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    say("display takes: " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(t1 - d.t0).count()) + "ms\n");
+    timer.next(Stage::present);
+    if (!on_frame(fb, key.vp))
+      frame_lost = true;
+    timer.stop();
+    PROFILE_FRAME();
+  }
+
+  // once nothing allocated from the slot's arena is left
+  void release(size_t slot) {
+    slots[slot].arena.rewind();
+    free_slots.push(slot);
+  }
+
+  void raster_loop() {
+    while (auto d = pending.pop()) {
+      const auto slot = d->slot;
+      rasterize(*d);
+      d.reset();
+      release(slot);
+    }
+  }
+
+  // waits until every display in flight is out, before objects change under the raster stage
+  void drain() {
+    if (!raster_thread.joinable())
+      return;
+    std::array<size_t, display_slots> taken;
+    for (auto& slot : taken)
+      slot = free_slots.pop();
+    for (const auto slot : taken)
+      free_slots.push(slot);
+  }
+
+public:
+  // pipelined needs an on_frame and a report that may be called from another thread, a window's usually cannot
+  Scene(int win_x, int win_y, MeshRegistry& meshes, FrameSink on_frame, Report report, std::filesystem::path script_dir = {}, bool pipelined = false)
+      : win_x{win_x}, win_y{win_y}, meshes{meshes}, on_frame{std::move(on_frame)}, report{std::move(report)}, script_dir{std::move(script_dir)} {
+    // one slot does unless displays overlap, and then repeated displays find their cache in it
+    for (size_t slot = 0; slot < (pipelined ? display_slots : 1); ++slot) {
+      slots[slot].fb.resize(win_x, win_y);
+      free_slots.push(slot);
+    }
+    if (pipelined)
+      raster_thread = std::thread{[this] { raster_loop(); }};
+  }
+  Scene(const Scene&) = delete;
+  Scene& operator=(const Scene&) = delete;
+  ~Scene() {
+    if (raster_thread.joinable()) {
+      pending.push(std::nullopt);
+      raster_thread.join();
+    }
+  }
+
+  auto has_ended() const { return ended; }
+
+  // one line of the script, false once it has ended
+  auto execute(const std::string& line) {
+    if (ended)
+      return false;
+    std::istringstream ss{line};
+    std::string str;
+    ss >> str;
+    switch (operator""_hash(str.c_str(), str.size())) {
+    case "scale"_hash:
+      TM = process_scale(ss) * TM;
+      break;
+    case "rotate"_hash:
+      TM = process_rotate(ss) * TM;
+      break;
+    case "translate"_hash:
+      TM = process_translate(ss) * TM;
+      break;
+    case "viewport"_hash:
+      vp = process_viewport(ss);
+      break;
+    case "object"_hash:
+      drain(); // objects may move when they grow
+      objects.push_back(process_object(ss));
+      break;
+    case "observer"_hash:
+      ob_ov = process_observer(ss);
+      break;
+    case "display"_hash:
+      process_display();
+      break;
+    case "ambient"_hash:
+      ambient = process_ambient(ss);
+      ++lighting_version;
+      break;
+    case "background"_hash:
+      background = process_background(ss);
+      break;
+    case "light"_hash:
+      process_light(ss);
+      ++lighting_version;
+      break;
+    case "pick"_hash:
+      process_pick(ss);
+      break;
+    case "nobackfaces"_hash:
+      nobackfaces = true;
+      break;
+    case "fronttoback"_hash:
+      fronttoback = true;
+      break;
+    case "deferred"_hash:
+      deferred = true;
+      break;
+    case "shading"_hash:
+      shading = process_shading(ss);
+      break;
+    case "end"_hash:
+      drain();
+      ended = true;
+      return false;
+    case "reset"_hash:
+      TM = identity_matrix;
+      [[fallthrough]];
+    case ""_hash: // newlines fall into this case
+    case "#"_hash:
+      break;
+    } // catches all cases no default!
+    return true;
+  }
+
+  // the rest of a script, line by line as it arrives, every display is out when it returns.
+  // false if on_frame failed for any display so far, has_ended tells whether the script ended with end or with the input
+  auto run(std::istream& script) {
+    for (std::string line; std::getline(script, line);)
+      if (!execute(line))
+        break;
+    drain();
+    return !frame_lost;
+  }
+};
@@ -0,0 +1,23 @@
+#pragma once
+#include "MatrixKit.hpp"
+#include <tuple>
+
+struct Viewport {
+  real AR, vxl, vxr, vyb, vyt;
+  int win_x, win_y;
+
+  [[nodiscard]] auto get_borders() const {
+    const auto b = [&](const auto& v, const auto win) { return static_cast<int>(std::round((1 + v) * win / 2)); };
+    return std::tuple{b(vxl, win_x), b(vxr, win_x), b(vyb, win_y), b(vyt, win_y)};
+  }
+
+  // map normalized device coordinates to window coordinates
+  [[nodiscard]] auto get_matrix() const {
+    const auto [l, r, b, t] = get_borders();
+    return translation_m(l, b) * scaling_m((r - l) / 2.0, (t - b) / 2.0) * translation_m(1.0, 1.0);
+  }
+};
+
+inline auto operator==(const Viewport& a, const Viewport& b) {
+  return std::tie(a.AR, a.vxl, a.vxr, a.vyb, a.vyt, a.win_x, a.win_y) == std::tie(b.AR, b.vxl, b.vxr, b.vyb, b.vyt, b.win_x, b.win_y);
+}
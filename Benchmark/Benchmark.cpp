@@ -0,0 +1,170 @@
+// runs the shipped scripts of labs 2 to 4 headlessly, every run in a fresh process, and reports how long each stage of
+// the pipeline took as JSON: min, median and p99 over the iterations, in milliseconds.
+// usage: Benchmark --lab2 path/to/Lab2 --lab3 path/to/Lab3 --lab4 path/to/Lab4 [--iterations 10] [--warmup 1] [--root .] [--out bench.json]
+// labs without an executable are skipped, root is the top of the repository
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+namespace fs = std::filesystem;
+
+constexpr std::array<const char*, 7> stage_names{"parse", "load", "shade", "transform", "clip", "rasterize", "present"};
+using StageTimes = std::array<double, stage_names.size()>;
+
+struct Suite {
+  const char* lab;
+  const char* directory; // where the scripts and their meshes are, relative to the root
+  std::vector<const char*> scripts;
+};
+
+const std::array<Suite, 3> suites{{
+    {"lab2", "Assignment_2/2019CG_Lab2_105502042/Debug", {"lab2A.in", "lab2B.in", "lab2C.in", "lab2D.in", "lab2E.in"}},
+    {"lab3", "Assignment_3/2019CG_Lab3_105502042/Debug", {"Lab3A.in", "Lab3B.in", "Lab3C.in", "Lab3D.in", "Lab3E.in"}},
+    {"lab4", "Assignment_4/2019CG_Lab4_105502042/Debug", {"lab4A.in", "lab4B.in", "lab4C.in", "lab4D.in"}},
+}};
+
+// the numbers of a `stages {"parse": 1.5, ...}` line, nothing if a stage is missing
+auto parse_stages(const std::string& line) -> std::optional<StageTimes> {
+  StageTimes times;
+  for (size_t i = 0; i < stage_names.size(); ++i) {
+    const auto key = '"' + std::string{stage_names[i]} + "\":";
+    const auto at = line.find(key);
+    if (at == std::string::npos)
+      return std::nullopt;
+    std::istringstream{line.substr(at + key.size())} >> times[i];
+  }
+  return times;
+}
+
+// run a lab on a script from the script's directory, the stage times it prints at the end or nothing if it failed
+auto run_once(const fs::path& exe, const fs::path& directory, const std::string& script, const fs::path& out_prefix) -> std::optional<StageTimes> {
+  fs::current_path(directory);
+  auto command = '"' + exe.string() + "\" " + script + " \"" + out_prefix.string() + "\" --stages";
+#ifdef _WIN32
+  command = '"' + command + '"'; // cmd strips the outermost pair of quotes
+#endif
+  const auto pipe = popen(command.c_str(), "r");
+  if (!pipe)
+    return std::nullopt;
+  std::optional<StageTimes> times;
+  std::string line;
+  for (std::array<char, 512> buffer; std::fgets(buffer.data(), static_cast<int>(buffer.size()), pipe);) {
+    line += buffer.data();
+    if (line.back() != '\n')
+      continue;
+    if (line.rfind("stages ", 0) == 0)
+      times = parse_stages(line);
+    line.clear();
+  }
+  return pclose(pipe) == 0 ? times : std::nullopt;
+}
+
+// nearest-rank percentile of sorted samples
+auto percentile(const std::vector<double>& sorted, double p) {
+  const auto rank = static_cast<size_t>(std::ceil(p / 100 * sorted.size()));
+  return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+auto write_summary(std::ostream& out, std::vector<double> samples) {
+  std::sort(samples.begin(), samples.end());
+  out << "{\"min\": " << samples.front() << ", \"median\": " << percentile(samples, 50) << ", \"p99\": " << percentile(samples, 99) << '}';
+}
+
+auto main(int argc, char* argv[]) -> int {
+  std::map<std::string, fs::path> exes;
+  int iterations{10}, warmup{1};
+  fs::path root{fs::current_path()}, out_path;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string flag{argv[i]}, value{argv[i + 1]};
+    if (flag == "--iterations")
+      iterations = std::max(1, std::stoi(value));
+    else if (flag == "--warmup")
+      warmup = std::max(0, std::stoi(value));
+    else if (flag == "--root")
+      root = fs::absolute(value);
+    else if (flag == "--out")
+      out_path = fs::absolute(value);
+    else if (flag.rfind("--lab", 0) == 0)
+      exes[flag.substr(2)] = fs::absolute(value);
+    else
+      std::cerr << "unknown option " << flag << '\n';
+  }
+  if (exes.empty()) {
+    std::cerr << "usage: Benchmark --lab2 Lab2 --lab3 Lab3 --lab4 Lab4 [--iterations 10] [--warmup 1] [--root .] [--out bench.json]\n";
+    return EXIT_FAILURE;
+  }
+
+  const auto frames = fs::temp_directory_path() / "cg_benchmark"; // what the labs render goes here, the writes count as present
+  fs::create_directories(frames);
+
+  std::ostringstream json;
+  json << "{\n  \"iterations\": " << iterations << ",\n  \"unit\": \"ms\",\n  \"scripts\": [";
+  bool first_script{true}, failed{false};
+  for (const auto& suite : suites) {
+    const auto exe = exes.find(suite.lab);
+    if (exe == exes.end())
+      continue;
+    for (const std::string script : suite.scripts) {
+      std::cerr << suite.lab << ' ' << script << '\n';
+      const auto prefix = frames / (std::string{suite.lab} + '_' + script + '_');
+      std::vector<StageTimes> runs;
+      for (int i = 0; i < warmup + iterations; ++i) {
+        const auto times = run_once(exe->second, root / suite.directory, script, prefix);
+        if (!times)
+          break;
+        if (i >= warmup)
+          runs.push_back(*times);
+      }
+
+      json << (first_script ? "\n" : ",\n") << "    {\"lab\": \"" << suite.lab << "\", \"script\": \"" << script << '"';
+      first_script = false;
+      if (runs.size() != static_cast<size_t>(iterations)) {
+        std::cerr << "  failed\n";
+        json << ", \"error\": \"run failed\"}";
+        failed = true;
+        continue;
+      }
+      json << ",\n     \"stages\": {";
+      for (size_t s = 0; s < stage_names.size(); ++s) {
+        std::vector<double> samples;
+        for (const auto& r : runs)
+          samples.push_back(r[s]);
+        json << (s ? ",\n                " : "") << '"' << stage_names[s] << "\": ";
+        write_summary(json, samples);
+      }
+      std::vector<double> totals;
+      for (const auto& r : runs) {
+        double total{0};
+        for (const auto t : r)
+          total += t;
+        totals.push_back(total);
+      }
+      json << "},\n     \"total\": ";
+      write_summary(json, totals);
+      json << '}';
+    }
+  }
+  json << "\n  ]\n}\n";
+
+  if (out_path.empty()) {
+    std::cout << json.str();
+  } else if (!(std::ofstream{out_path} << json.str())) {
+    std::cerr << "cannot write " << out_path << '\n';
+    return EXIT_FAILURE;
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}